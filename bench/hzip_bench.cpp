@@ -0,0 +1,472 @@
+// bench/hzip_bench.cpp
+// Throughput benchmark over deterministic synthetic corpora.
+#include "HuffmanEncoder.h"
+#include "HuffmanDecoder.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct BenchOptions {
+    size_t size = 16u << 20;
+    int iterations = 3;
+    unsigned threads = 0;
+    std::string corpus;
+    std::string jsonPath;
+    std::string baselinePath;
+    double tolerance = 10.0;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t bytes = 0;
+    uint64_t compressedBytes = 0;
+    double ratio = 0;
+    double compressMBps = 0;
+    double decompressMBps = 0;
+    double fileCompressMBps = 0;
+    double fileDecompressMBps = 0;
+    uint64_t peakRssKiB = 0;
+    EncoderPhaseTimes encodeTimes;
+    DecoderPhaseTimes decodeTimes;
+};
+
+// splitmix64; the corpora must be identical on every run and platform
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound)
+    uint32_t below(uint32_t bound) { return static_cast<uint32_t>(next() % bound); }
+
+    // Roughly Zipf-distributed index in [0, bound): small values are common
+    uint32_t skewed(uint32_t bound) {
+        double u = static_cast<double>(next() >> 11) / 9007199254740992.0;
+        return std::min(bound - 1, static_cast<uint32_t>(bound * u * u * u));
+    }
+
+private:
+    uint64_t state;
+};
+
+const char* const WORDS[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on",
+    "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they",
+    "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if", "more", "when",
+    "will", "would", "who", "so", "no", "compression", "Huffman", "block", "symbol", "frequency", "table",
+    "stream", "decoder", "encoder", "buffer", "thread", "index", "length", "canonical", "entropy",
+};
+const uint32_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+std::vector<uint8_t> makeText(size_t size) {
+    Random random(1);
+    std::string out;
+    out.reserve(size + 64);
+    bool startOfSentence = true;
+    while (out.size() < size) {
+        std::string word = WORDS[random.skewed(WORD_COUNT)];
+        if (startOfSentence) {
+            word[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])));
+            startOfSentence = false;
+        }
+        out += word;
+        uint32_t r = random.below(100);
+        if (r < 6) {
+            out += ". ";
+            startOfSentence = true;
+        } else if (r < 10) {
+            out += ", ";
+        } else if (r < 11) {
+            out += ".\n\n";
+            startOfSentence = true;
+        } else {
+            out += ' ';
+        }
+    }
+    out.resize(size);
+    return std::vector<uint8_t>(out.begin(), out.end());
+}
+
+std::vector<uint8_t> makeLogs(size_t size) {
+    static const char* const LEVELS[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+    static const char* const PATHS[] = {"/api/v1/items", "/api/v1/users", "/healthz", "/api/v2/search", "/static/app.js"};
+    static const int STATUS[] = {200, 200, 200, 204, 304, 404, 500};
+    Random random(2);
+    std::string out;
+    out.reserve(size + 256);
+    uint64_t millis = 1700000000000ull;
+    char line[256];
+    while (out.size() < size) {
+        millis += random.below(50);
+        int length = std::snprintf(line, sizeof(line),
+                                   "2024-03-%02u %02u:%02u:%02u.%03u %s [worker-%u] request id=%08x path=%s/%u status=%d latency=%ums\n",
+                                   1 + static_cast<unsigned>(millis / 86400000 % 28), static_cast<unsigned>(millis / 3600000 % 24),
+                                   static_cast<unsigned>(millis / 60000 % 60), static_cast<unsigned>(millis / 1000 % 60),
+                                   static_cast<unsigned>(millis % 1000), LEVELS[random.skewed(6)], random.below(16),
+                                   static_cast<unsigned>(random.next()), PATHS[random.skewed(5)], random.skewed(10000),
+                                   STATUS[random.skewed(7)], random.skewed(2000));
+        out.append(line, static_cast<size_t>(length));
+    }
+    out.resize(size);
+    return std::vector<uint8_t>(out.begin(), out.end());
+}
+
+std::vector<uint8_t> makeSkewed(size_t size) {
+    Random random(3);
+    std::vector<uint8_t> out(size);
+    for (uint8_t& byte : out) {
+        byte = static_cast<uint8_t>(random.skewed(256));
+    }
+    return out;
+}
+
+std::vector<uint8_t> makeRandom(size_t size) {
+    Random random(4);
+    std::vector<uint8_t> out(size);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t value = random.next();
+        std::memcpy(out.data() + i, &value, std::min<size_t>(8, size - i));
+    }
+    return out;
+}
+
+std::vector<uint8_t> makeSingle(size_t size) {
+    return std::vector<uint8_t>(size, 'a');
+}
+
+struct Corpus {
+    const char* name;
+    std::vector<uint8_t> (*generate)(size_t);
+};
+
+const Corpus CORPORA[] = {
+    {"text", makeText},
+    {"logs", makeLogs},
+    {"skewed", makeSkewed},
+    {"random", makeRandom},
+    {"single", makeSingle},
+};
+
+// Reset the peak resident set size so it can be measured per corpus. Only
+// Linux supports this; elsewhere the reported peak is for the whole run.
+void resetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs) {
+        clearRefs << "5";
+    }
+}
+
+uint64_t peakRssKiB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+double megabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0 ? static_cast<double>(bytes) / 1e6 / seconds : 0;
+}
+
+// Best of `iterations` runs of `run`, in seconds
+template <typename F>
+double bestTime(int iterations, F run) {
+    double best = 0;
+    for (int i = 0; i < iterations; ++i) {
+        StatsClock::time_point start = StatsClock::now();
+        run();
+        double seconds = lapSeconds(start);
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+BenchResult runCorpus(const Corpus& corpus, const BenchOptions& options, const fs::path& workDir) {
+    BenchResult result;
+    result.name = corpus.name;
+    resetPeakRss();
+    std::vector<uint8_t> data = corpus.generate(options.size);
+    result.bytes = data.size();
+
+    // In-memory codec throughput on one thread
+    HuffmanEncoder encoder;
+    HuffmanDecoder decoder;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> restored;
+    double compressSeconds = bestTime(options.iterations, [&]() { encoder.compress(data.data(), data.size(), compressed); });
+    double decompressSeconds = bestTime(options.iterations, [&]() {
+        decoder.decompress(compressed.data(), compressed.size(), restored);
+    });
+    if (restored != data) {
+        throw std::runtime_error(std::string("Round trip mismatch on corpus ") + corpus.name);
+    }
+    result.compressedBytes = compressed.size();
+    result.ratio = data.empty() ? 0 : static_cast<double>(compressed.size()) / static_cast<double>(data.size());
+    result.compressMBps = megabytesPerSecond(data.size(), compressSeconds);
+    result.decompressMBps = megabytesPerSecond(data.size(), decompressSeconds);
+    result.encodeTimes = encoder.lastPhaseTimes();
+    result.decodeTimes = decoder.lastPhaseTimes();
+
+    // End-to-end file throughput with the thread pool
+    fs::path inputPath = workDir / corpus.name;
+    fs::path compressedPath = workDir / (std::string(corpus.name) + ".huff");
+    fs::path outputPath = workDir / (std::string(corpus.name) + ".out");
+    {
+        std::ofstream input(inputPath, std::ios::binary);
+        input.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    EncoderOptions encoderOptions;
+    encoderOptions.threads = options.threads;
+    DecoderOptions decoderOptions;
+    decoderOptions.threads = options.threads;
+    HuffmanEncoder fileEncoder(encoderOptions);
+    HuffmanDecoder fileDecoder(decoderOptions);
+
+    // The file functions report progress; keep it out of the results
+    std::ostringstream discard;
+    std::streambuf* savedOut = std::cout.rdbuf(discard.rdbuf());
+    std::streambuf* savedErr = std::cerr.rdbuf(discard.rdbuf());
+    double fileCompressSeconds = bestTime(options.iterations, [&]() {
+        fileEncoder.compress(inputPath.string(), compressedPath.string());
+        discard.str("");
+    });
+    double fileDecompressSeconds = bestTime(options.iterations, [&]() {
+        fileDecoder.decompress(compressedPath.string(), outputPath.string());
+        discard.str("");
+    });
+    std::cout.rdbuf(savedOut);
+    std::cerr.rdbuf(savedErr);
+    result.fileCompressMBps = megabytesPerSecond(data.size(), fileCompressSeconds);
+    result.fileDecompressMBps = megabytesPerSecond(data.size(), fileDecompressSeconds);
+    fs::remove(inputPath);
+    fs::remove(compressedPath);
+    fs::remove(outputPath);
+
+    result.peakRssKiB = peakRssKiB();
+    return result;
+}
+
+void writeJson(std::ostream& out, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    // One corpus per line, which is what readBaseline expects
+    out << std::fixed << std::setprecision(4);
+    out << "{\n";
+    out << "  \"size\": " << options.size << ",\n";
+    out << "  \"threads\": " << ThreadPool::resolveThreadCount(options.threads) << ",\n";
+    out << "  \"corpora\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"bytes\": " << r.bytes
+            << ", \"compressed_bytes\": " << r.compressedBytes << ", \"ratio\": " << r.ratio
+            << ", \"compress_mbps\": " << r.compressMBps << ", \"decompress_mbps\": " << r.decompressMBps
+            << ", \"file_compress_mbps\": " << r.fileCompressMBps
+            << ", \"file_decompress_mbps\": " << r.fileDecompressMBps << ", \"peak_rss_kib\": " << r.peakRssKiB
+            << ", \"phases_ms\": {\"histogram\": " << r.encodeTimes.histogram * 1e3
+            << ", \"tree\": " << r.encodeTimes.tree * 1e3 << ", \"header\": " << r.encodeTimes.header * 1e3
+            << ", \"encode\": " << r.encodeTimes.encode * 1e3 << ", \"checksum\": " << r.encodeTimes.checksum * 1e3
+            << ", \"decode_table\": " << r.decodeTimes.table * 1e3 << ", \"decode\": " << r.decodeTimes.decode * 1e3
+            << ", \"verify\": " << r.decodeTimes.checksum * 1e3 << "}}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+// Value of "key": <number> in one line of JSON written by writeJson
+bool jsonNumber(const std::string& line, const std::string& key, double& value) {
+    std::string pattern = "\"" + key + "\": ";
+    size_t pos = line.find(pattern);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    value = std::strtod(line.c_str() + pos + pattern.size(), nullptr);
+    return true;
+}
+
+std::vector<BenchResult> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Unable to open baseline file: " + path);
+    }
+    std::vector<BenchResult> baseline;
+    std::string line;
+    const std::string namePattern = "{\"name\": \"";
+    while (std::getline(in, line)) {
+        size_t pos = line.find(namePattern);
+        if (pos == std::string::npos) {
+            continue;
+        }
+        BenchResult r;
+        size_t begin = pos + namePattern.size();
+        r.name = line.substr(begin, line.find('"', begin) - begin);
+        jsonNumber(line, "ratio", r.ratio);
+        jsonNumber(line, "compress_mbps", r.compressMBps);
+        jsonNumber(line, "decompress_mbps", r.decompressMBps);
+        jsonNumber(line, "file_compress_mbps", r.fileCompressMBps);
+        jsonNumber(line, "file_decompress_mbps", r.fileDecompressMBps);
+        baseline.push_back(r);
+    }
+    return baseline;
+}
+
+// Print every metric that is worse than the baseline by more than the
+// tolerance and return how many there were
+int compareWithBaseline(std::ostream& out, const std::vector<BenchResult>& results,
+                               const std::vector<BenchResult>& baseline, double tolerance) {
+    int regressions = 0;
+    auto checkSpeed = [&](const std::string& corpus, const char* metric, double current, double previous) {
+        if (previous > 0 && current < previous * (1.0 - tolerance / 100.0)) {
+            out << "REGRESSION " << corpus << " " << metric << ": " << current << " MB/s (baseline "
+                      << previous << " MB/s, " << (current / previous - 1.0) * 100.0 << "%)\n";
+            regressions++;
+        }
+    };
+    for (const BenchResult& r : results) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const BenchResult& b) { return b.name == r.name; });
+        if (it == baseline.end()) {
+            continue;
+        }
+        checkSpeed(r.name, "compress", r.compressMBps, it->compressMBps);
+        checkSpeed(r.name, "decompress", r.decompressMBps, it->decompressMBps);
+        checkSpeed(r.name, "file compress", r.fileCompressMBps, it->fileCompressMBps);
+        checkSpeed(r.name, "file decompress", r.fileDecompressMBps, it->fileDecompressMBps);
+        // The ratio is deterministic, so any real increase is a regression
+        if (r.ratio > it->ratio + 1e-4) {
+            out << "REGRESSION " << r.name << " ratio: " << r.ratio << " (baseline " << it->ratio << ")\n";
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+void printUsage(std::ostream& out) {
+    out << "Usage: hzip_bench [options]\n";
+    out << "  --size <MiB>         Bytes per corpus in MiB (default 16)\n";
+    out << "  --iterations <n>     Runs per measurement; the best is reported (default 3)\n";
+    out << "  -T <threads>         Worker threads for the file runs (default: one per core)\n";
+    out << "  --corpus <name>      Run one corpus only: text, logs, skewed, random or single\n";
+    out << "  --json <file>        Write the results as JSON (- for standard output)\n";
+    out << "  --baseline <file>    Compare with JSON from an earlier run and exit with status 1\n";
+    out << "                       when a metric regressed\n";
+    out << "  --tolerance <pct>    Allowed throughput loss against the baseline (default 10)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions options;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-h" || arg == "--help") {
+                printUsage(std::cout);
+                return EXIT_SUCCESS;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Option " << arg << " requires a value\n\n";
+                printUsage(std::cerr);
+                return EXIT_FAILURE;
+            }
+            std::string value = argv[++i];
+            if (arg == "--size") {
+                options.size = static_cast<size_t>(std::stod(value) * (1u << 20));
+            } else if (arg == "--iterations") {
+                options.iterations = std::max(1, std::stoi(value));
+            } else if (arg == "-T") {
+                options.threads = static_cast<unsigned>(std::stoul(value));
+            } else if (arg == "--corpus") {
+                options.corpus = value;
+            } else if (arg == "--json") {
+                options.jsonPath = value;
+            } else if (arg == "--baseline") {
+                options.baselinePath = value;
+            } else if (arg == "--tolerance") {
+                options.tolerance = std::stod(value);
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n\n";
+                printUsage(std::cerr);
+                return EXIT_FAILURE;
+            }
+        }
+
+        fs::path workDir = fs::temp_directory_path() / ("hzip_bench." + std::to_string(::getpid()));
+        fs::create_directories(workDir);
+
+        std::vector<BenchResult> results;
+        std::ostream& report = options.jsonPath == "-" ? std::cerr : std::cout;
+        report << std::fixed << std::setprecision(1);
+        report << std::left << std::setw(8) << "corpus" << std::right << std::setw(8) << "ratio" << std::setw(10)
+               << "comp MB/s" << std::setw(10) << "dec MB/s" << std::setw(11) << "file comp" << std::setw(10)
+               << "file dec" << std::setw(10) << "RSS MiB" << "  phases ms (hist/tree/hdr/enc | table/dec)\n";
+        for (const Corpus& corpus : CORPORA) {
+            if (!options.corpus.empty() && options.corpus != corpus.name) {
+                continue;
+            }
+            BenchResult r = runCorpus(corpus, options, workDir);
+            report << std::left << std::setw(8) << r.name << std::right << std::setw(7) << r.ratio * 100 << "%"
+                   << std::setw(10) << r.compressMBps << std::setw(10) << r.decompressMBps << std::setw(11)
+                   << r.fileCompressMBps << std::setw(10) << r.fileDecompressMBps << std::setw(10)
+                   << r.peakRssKiB / 1024.0 << "  " << std::setprecision(2) << r.encodeTimes.histogram * 1e3 << "/"
+                   << r.encodeTimes.tree * 1e3 << "/" << r.encodeTimes.header * 1e3 << "/"
+                   << r.encodeTimes.encode * 1e3 << " | " << r.decodeTimes.table * 1e3 << "/"
+                   << r.decodeTimes.decode * 1e3 << std::setprecision(1) << "\n";
+            results.push_back(r);
+        }
+        fs::remove_all(workDir);
+        if (results.empty()) {
+            throw std::invalid_argument("Unknown corpus: " + options.corpus);
+        }
+
+        if (options.jsonPath == "-") {
+            writeJson(std::cout, options, results);
+        } else if (!options.jsonPath.empty()) {
+            std::ofstream json(options.jsonPath);
+            if (!json) {
+                throw std::runtime_error("Unable to open output file: " + options.jsonPath);
+            }
+            writeJson(json, options, results);
+        }
+
+        if (!options.baselinePath.empty()) {
+            int regressions = compareWithBaseline(report, results, readBaseline(options.baselinePath), options.tolerance);
+            if (regressions > 0) {
+                report << regressions << " regression(s) against " << options.baselinePath << "\n";
+                return EXIT_FAILURE;
+            }
+            report << "No regressions against " << options.baselinePath << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
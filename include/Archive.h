@@ -0,0 +1,38 @@
+// include/Archive.h
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One file of an archive: its name relative to the archived directory and
+// where its bytes lie in the decompressed stream
+struct ArchiveEntry {
+    std::string name;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+// Regular files under `directory`, recursively, as paths relative to it
+// with '/' separators, in sorted order
+std::vector<std::string> listArchiveFiles(const std::string& directory);
+
+// Append the directory of `entries` and the archive trailer to out; the
+// compressed stream before them is streamSize bytes
+void appendArchiveDirectory(std::vector<uint8_t>& out, const std::vector<ArchiveEntry>& entries,
+                            uint64_t streamSize);
+
+// Whether a fileSize-byte file ends with an archive trailer
+bool isArchive(int fd, uint64_t fileSize);
+
+// Validate the archive trailer and directory of a fileSize-byte archive and
+// return its entries; streamSize is set to the size of the compressed stream
+std::vector<ArchiveEntry> readArchiveDirectory(int fd, uint64_t fileSize, const std::string& archivePath,
+                                               uint64_t& streamSize);
+
+// Throws unless `name` is a relative path that stays inside the directory
+// it is extracted to
+void checkArchiveName(const std::string& name);
+
+#endif // ARCHIVE_H
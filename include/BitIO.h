@@ -1,38 +1,100 @@
-// include/BitIO.h
-#ifndef BITIO_H
-#define BITIO_H
-
-#include <fstream>
-#include <vector>
-#include <cstdint>
-
-class BitWriter {
-public:
-    BitWriter(std::ofstream& output);
-    void writeBit(bool bit);
-    void writeBits(const std::vector<bool>& bits);
-    void writeByte(uint8_t byte);
-    void flush();
-    int flushAndGetPadding();
-    int getBitCount() const;
-
-private:
-    std::ofstream& out;
-    uint8_t buffer;
-    int bitCount;
-};
-
-class BitReader {
-public:
-    BitReader(std::ifstream& input, size_t dataSize);
-    bool readBit(bool& bit);
-
-private:
-    std::ifstream& in;
-    uint8_t buffer;
-    int bitCount;
-    size_t bytesRead;
-    size_t dataSize;
-};
-
-#endif // BITIO_H
+// include/BitIO.h
+#ifndef BITIO_H
+#define BITIO_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Bits are written and read most significant bit first, to and from byte
+// buffers in memory. Both classes keep a 64-bit accumulator and move whole
+// bytes at a time.
+class BitWriter {
+public:
+    // Append to the end of `output`
+    explicit BitWriter(std::vector<uint8_t>& output);
+
+    // Append the low `length` bits of `code` (length <= 32, no bits set above it)
+    void writeBits(uint64_t code, int length) {
+        bitBuffer = (bitBuffer << length) | code;
+        bitCount += length;
+        if (bitCount >= 32) {
+            drain32();
+        }
+    }
+
+    // Pad the last byte with zero bits and trim the output to the bytes written
+    void flush();
+
+private:
+    void drain32() {
+        if (bufferPos + 4 > buffer.size()) {
+            growBuffer();
+        }
+        uint32_t word = static_cast<uint32_t>(bitBuffer >> (bitCount - 32));
+        buffer[bufferPos++] = static_cast<uint8_t>(word >> 24);
+        buffer[bufferPos++] = static_cast<uint8_t>(word >> 16);
+        buffer[bufferPos++] = static_cast<uint8_t>(word >> 8);
+        buffer[bufferPos++] = static_cast<uint8_t>(word);
+        bitCount -= 32;
+    }
+    void growBuffer();
+
+    std::vector<uint8_t>& buffer;    // The output vector, grown ahead of bufferPos
+    size_t bufferPos;
+    uint64_t bitBuffer; // Pending bits are the low bitCount bits
+    int bitCount;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t dataSize);
+
+    // Top up the accumulator to at least 57 bits. Past the end of the data
+    // the reader supplies zero bits; see exhausted().
+    void refill() {
+        if (bitCount > 56) {
+            return;
+        }
+        if (end - cur >= 8) {
+            uint64_t word = 0;
+            for (int i = 0; i < 8; ++i) {
+                word = (word << 8) | cur[i];
+            }
+            // Bytes that only partly fit are re-read by the next refill and
+            // OR-ed onto identical bits
+            bitBuffer |= word >> bitCount;
+            int bytes = (63 - bitCount) >> 3;
+            cur += bytes;
+            bitCount += bytes * 8;
+            return;
+        }
+        refillSlow();
+    }
+
+    // The next `count` bits (1..32) without consuming them; call refill() first
+    uint32_t peekBits(int count) const {
+        return static_cast<uint32_t>(bitBuffer >> (64 - count));
+    }
+
+    void consumeBits(int count) {
+        bitBuffer <<= count;
+        bitCount -= count;
+    }
+
+    // True once more bits were consumed than the data contains
+    bool exhausted() const {
+        return paddingBits > bitCount;
+    }
+
+private:
+    void refillSlow();
+
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint64_t bitBuffer; // Valid bits are the top bitCount bits
+    int bitCount;
+    int paddingBits;    // Zero bits appended after the end of the data
+};
+
+#endif // BITIO_H
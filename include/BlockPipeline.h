@@ -0,0 +1,138 @@
+// include/BlockPipeline.h
+#ifndef BLOCKPIPELINE_H
+#define BLOCKPIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SpscRing.h"
+#include "Stats.h"
+
+// Reader, coder and writer stages that overlap input, coding and output.
+// The calling thread reads, `coders` threads code and one more thread writes.
+// Block n goes to coder n % coders, so the writer collects the blocks in
+// input order by visiting the coders in turn. Every link is an SpscRing, and
+// a fixed set of Job objects circulates from the reader through the coders
+// and the writer back to the reader, so their buffers are reused; each coder
+// has `jobsPerCoder` blocks of slack in front of and behind it.
+//
+// read(job) fills a job and returns false at the end of the input;
+// code(job) runs on the coder threads and write(job) on the writer thread,
+// in input order. The first exception thrown by any stage stops the
+// pipeline and is rethrown once every thread has finished.
+template <typename Job, typename Read, typename Code, typename Write>
+PipelineStalls runBlockPipeline(unsigned coders, Read read, Code code, Write write, size_t jobsPerCoder = 2) {
+    const unsigned coderCount = coders == 0 ? 1 : coders;
+    std::vector<Job> jobs(coderCount * jobsPerCoder + 2);
+    SpscRing<Job*> freeJobs(jobs.size());
+    std::vector<std::unique_ptr<SpscRing<Job*>>> toCoder;
+    std::vector<std::unique_ptr<SpscRing<Job*>>> fromCoder;
+    for (unsigned c = 0; c < coderCount; ++c) {
+        toCoder.push_back(std::make_unique<SpscRing<Job*>>(jobsPerCoder));
+        fromCoder.push_back(std::make_unique<SpscRing<Job*>>(jobsPerCoder));
+    }
+    for (Job& job : jobs) {
+        freeJobs.tryPush(&job);
+    }
+
+    std::atomic<bool> cancelled{false};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        cancelled.store(true);
+        freeJobs.wakeAll();
+        for (unsigned c = 0; c < coderCount; ++c) {
+            toCoder[c]->wakeAll();
+            fromCoder[c]->wakeAll();
+        }
+    };
+
+    PipelineStalls stalls;
+    std::vector<uint64_t> coderStalls(coderCount, 0);
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < coderCount; ++c) {
+        threads.emplace_back([&, c]() {
+            // Waiting on the writer already shows up in the reader and writer counts
+            uint64_t outputStalls = 0;
+            try {
+                // A null job marks the end of the input
+                Job* job = nullptr;
+                while (toCoder[c]->pop(job, cancelled, coderStalls[c]) && job) {
+                    code(*job);
+                    if (!fromCoder[c]->push(job, cancelled, outputStalls)) {
+                        return;
+                    }
+                }
+                if (!cancelled.load()) {
+                    fromCoder[c]->push(nullptr, cancelled, outputStalls);
+                }
+            } catch (...) {
+                fail();
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        try {
+            uint64_t freeStalls = 0;
+            StatsClock::time_point waitStart;
+            for (uint64_t n = 0;; ++n) {
+                Job* job = nullptr;
+                waitStart = StatsClock::now();
+                if (!fromCoder[n % coderCount]->pop(job, cancelled, stalls.writer) || !job) {
+                    return;
+                }
+                stalls.writerWait += lapSeconds(waitStart);
+                write(*job);
+                // Never waits: the ring holds every job
+                freeJobs.push(job, cancelled, freeStalls);
+            }
+        } catch (...) {
+            fail();
+        }
+    });
+
+    // This thread is the reader. Once the input ends, every coder gets the
+    // end marker; the writer meets it in block order.
+    try {
+        for (uint64_t n = 0;; ++n) {
+            Job* job = nullptr;
+            if (!freeJobs.pop(job, cancelled, stalls.reader)) {
+                break;
+            }
+            if (!read(*job)) {
+                for (unsigned c = 0; c < coderCount; ++c) {
+                    toCoder[(n + c) % coderCount]->push(nullptr, cancelled, stalls.reader);
+                }
+                break;
+            }
+            if (!toCoder[n % coderCount]->push(job, cancelled, stalls.reader)) {
+                break;
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    for (uint64_t count : coderStalls) {
+        stalls.coder += count;
+    }
+    return stalls;
+}
+
+#endif // BLOCKPIPELINE_H
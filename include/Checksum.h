@@ -0,0 +1,30 @@
+// include/Checksum.h
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli) of data[0, size), continuing a checksum `crc` of the
+// bytes before it (0 for none). The SSE4.2 crc32 instruction is used when the
+// CPU has it, over three interleaved lanes so its latency is hidden;
+// otherwise a slicing-by-8 table loop.
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+// Copy src[0, size) to dst and return its checksum, in one pass over the
+// data when the crc32 instruction is available
+uint32_t crc32cCopy(void* dst, const void* src, size_t size);
+
+// Checksum of A followed by B, given the checksums of A and B and the size
+// of B. Blocks are checksummed independently and combined in order.
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t sizeB);
+
+// Checksum of `count` copies of one byte value, without touching memory
+uint32_t crc32cRun(uint8_t value, uint64_t count);
+
+// 64-bit XXH64 hash of data[0, size), for fingerprinting blocks: about as
+// fast as the crc32 instruction and without its linearity, so equal hashes
+// of different data are as unlikely as for a random function
+uint64_t hash64(const void* data, size_t size);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,207 @@
+// include/Format.h
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+
+// Every compressed file starts with the magic bytes followed by the format version
+constexpr char FORMAT_MAGIC[4] = {'H', 'Z', 'I', 'P'};
+constexpr uint8_t FORMAT_VERSION = 12;
+
+// Layout (multi-byte integers are little-endian):
+//   file header:  magic (4) | version (1) | flags (1) | block size (4) |
+//                 table ID (4)
+//   each block:   raw size (4) | payload size (4) | checksum (4) |
+//                 block mode (1) | code lengths | encoded data
+//   end marker:   raw size (4) == 0
+//   block index:  per block: compressed size (varint) | raw size (varint)
+//   trailer:      block count (8) | index offset (8) | checksum (4) |
+//                 index magic (4)
+// Blocks are coded independently, each with its own code table. The index at
+// the end of the file lets readers locate every block without scanning; the
+// offsets follow from summing the sizes, as blocks are stored back to back
+// from the end of the file header. Varints are LEB128: seven bits per byte,
+// least significant group first, high bit set on all but the last byte.
+//
+// Checksums are CRC-32C (see Checksum.h) of the original bytes: of the block
+// in a block header, of all the data in the trailer. Decoders check both.
+//
+// A BLOCK_MODE_FOUR_STREAMS block splits its data into STREAM_COUNT
+// consecutive segments of ceil(raw size / 4) bytes (the last one shorter),
+// each coded as its own bit stream with the shared code table. The encoded
+// data then starts with the byte sizes of the first three streams (4 each),
+// followed by the four streams; decoders run them in lockstep.
+//
+// Files compressed with a shared table (see SharedTable.h) name its ID in
+// the file header, 0 otherwise. Huffman blocks whose mode has
+// BLOCK_MODE_SHARED_TABLE set use that table and carry no code lengths.
+//
+// Huffman blocks whose mode has BLOCK_MODE_RECENT_TABLE set reuse the code
+// table of an earlier block: instead of code lengths they carry the varint
+// distance d back to it, at most RECENT_TABLE_WINDOW. Block n - d must be a
+// Huffman block with code lengths of its own.
+//
+// A BLOCK_MODE_TANS block is coded with tANS (see TansCoder.h) instead of
+// Huffman codes. After the mode byte come the table log, between
+// TANS_MIN_TABLE_LOG and TANS_MAX_TABLE_LOG, the symbol count minus one, the
+// symbols as a list or bitmap like in the code lengths, one varint per symbol
+// (its normalized count minus one; the counts sum to 1 << table log), and
+// the tANS stream up to the end of the payload.
+//
+// A BLOCK_MODE_STORED block holds the raw bytes and a BLOCK_MODE_RLE block
+// the single byte value repeated raw size times; neither has code lengths.
+//
+// Files with FILE_FLAG_DEDUP set may contain BLOCK_MODE_REFERENCE blocks,
+// whose payload is the mode byte and a varint distance d: the block repeats
+// the block d blocks before it (raw size and checksum included). d is at
+// most dedupWindow(block size), so decoders that write in order only keep
+// that many blocks, no more than DEDUP_WINDOW_SIZE bytes, to copy from.
+constexpr size_t FILE_HEADER_SIZE = sizeof(FORMAT_MAGIC) + 1 + 1 + 4 + 4;
+constexpr size_t BLOCK_HEADER_SIZE = 4 + 4 + 4;
+constexpr size_t MAX_VARINT_SIZE = 10;
+// Both block sizes fit in 32 bits, which take at most 5 varint bytes each
+constexpr size_t MAX_INDEX_ENTRY_SIZE = 5 + 5;
+constexpr size_t TRAILER_SIZE = 8 + 8 + 4 + 4;
+constexpr char INDEX_MAGIC[4] = {'H', 'Z', 'I', 'X'};
+constexpr uint32_t DEFAULT_BLOCK_SIZE = 1u << 20;
+constexpr uint32_t MAX_BLOCK_SIZE = 1u << 30;
+
+// Code lengths are stored as 4-bit values in the header, which caps them at 15.
+// 8 bits is the smallest limit that still fits all 256 symbols.
+constexpr int MIN_CODE_LENGTH_LIMIT = 8;
+constexpr int MAX_CODE_LENGTH_LIMIT = 15;
+constexpr int DEFAULT_MAX_CODE_LENGTH = 15;
+
+// Alphabets with at least this many symbols are stored as a presence bitmap
+// instead of a symbol list
+constexpr size_t SYMBOL_BITMAP_SIZE = 256 / 8;
+
+// Bytes of the code lengths of a block with symbolCount symbols: count,
+// symbol list or bitmap, and two 4-bit lengths per byte
+inline size_t codeLengthsSize(size_t symbolCount) {
+    return 1 + (symbolCount < SYMBOL_BITMAP_SIZE ? symbolCount : SYMBOL_BITMAP_SIZE) + (symbolCount + 1) / 2;
+}
+
+// How the data of a block is coded and laid out
+constexpr uint8_t BLOCK_MODE_SINGLE_STREAM = 0;
+constexpr uint8_t BLOCK_MODE_FOUR_STREAMS = 1;
+constexpr uint8_t BLOCK_MODE_STORED = 2;
+constexpr uint8_t BLOCK_MODE_RLE = 3;
+constexpr uint8_t BLOCK_MODE_REFERENCE = 4;
+constexpr uint8_t BLOCK_MODE_TANS = 5;
+constexpr uint8_t BLOCK_MODE_RECENT_TABLE = 0x40;
+constexpr uint8_t BLOCK_MODE_SHARED_TABLE = 0x80;
+constexpr uint64_t RECENT_TABLE_WINDOW = 256;
+constexpr int STREAM_COUNT = 4;
+constexpr size_t STREAM_JUMP_TABLE_SIZE = (STREAM_COUNT - 1) * 4;
+// Smaller blocks are always single-stream; the jump table and the padding
+// of four streams would outweigh the faster decoding
+constexpr uint32_t MIN_MULTI_STREAM_BLOCK_SIZE = 1024;
+
+// tANS tables have 1 << table log states; TANS_STATE_COUNT interleaved
+// states take turns coding the symbols
+constexpr int TANS_MIN_TABLE_LOG = 5;
+constexpr int TANS_MAX_TABLE_LOG = 12;
+constexpr int TANS_STATE_COUNT = 4;
+
+// File header flags
+constexpr uint8_t FILE_FLAG_DEDUP = 0x01;
+constexpr uint64_t DEDUP_WINDOW_SIZE = 128u << 20;
+
+// Blocks a reference block may reach back, at least one
+inline uint64_t dedupWindow(uint32_t blockSize) {
+    return DEDUP_WINDOW_SIZE / blockSize > 0 ? DEDUP_WINDOW_SIZE / blockSize : 1;
+}
+
+// Shared table files: magic (4) | version (1) | table ID (4) | code lengths
+// of all 256 symbols, two 4-bit lengths per byte (128)
+constexpr char TABLE_MAGIC[4] = {'H', 'Z', 'D', 'T'};
+constexpr uint8_t TABLE_FORMAT_VERSION = 1;
+constexpr size_t TABLE_FILE_SIZE = sizeof(TABLE_MAGIC) + 1 + 4 + 256 / 2;
+
+// Archives (-r) hold the contents of all their files, back to back, as one
+// compressed stream like the above, followed by a directory:
+//   directory:    per file: name size (varint) | name | file size (varint)
+//   trailer:      file count (8) | directory offset (8) | directory
+//                 checksum (4) | archive magic (4)
+// Names are relative paths with '/' separators, in stream order; the
+// directory offset is also the size of the stream. Only regular files are
+// recorded: empty directories are skipped and not recreated on extraction.
+constexpr char ARCHIVE_MAGIC[4] = {'H', 'Z', 'A', 'R'};
+constexpr size_t ARCHIVE_TRAILER_SIZE = 8 + 8 + 4 + 4;
+
+// Upper bound for a block payload: encoders store a block raw rather than
+// let its coded form grow past the mode byte and the raw bytes
+inline uint64_t maxPayloadSize(uint32_t rawSize) {
+    return 1 + static_cast<uint64_t>(rawSize);
+}
+
+// Location of one block in the compressed file and in the original data.
+// The compressed range covers the block header.
+struct BlockIndexEntry {
+    uint64_t compressedOffset;
+    uint32_t compressedSize;
+    uint64_t rawOffset;
+    uint32_t rawSize;
+};
+
+inline void storeUint32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline void appendUint32(std::vector<uint8_t>& out, uint32_t value) {
+    out.resize(out.size() + 4);
+    storeUint32(&out[out.size() - 4], value);
+}
+
+inline void appendUint64(std::vector<uint8_t>& out, uint64_t value) {
+    appendUint32(out, static_cast<uint32_t>(value));
+    appendUint32(out, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint32_t loadUint32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+inline uint64_t loadUint64(const uint8_t* in) {
+    return static_cast<uint64_t>(loadUint32(in)) | (static_cast<uint64_t>(loadUint32(in + 4)) << 32);
+}
+
+inline void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Bytes appendVarint writes for value
+inline size_t varintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// Read a varint from [cur, end) and advance cur past it
+inline uint64_t readVarint(const uint8_t*& cur, const uint8_t* end) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < MAX_VARINT_SIZE && cur != end; ++i) {
+        uint8_t byte = *cur++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt varint");
+}
+
+#endif // FORMAT_H
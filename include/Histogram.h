@@ -0,0 +1,24 @@
+// include/Histogram.h
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include "HuffmanTree.h"
+
+// Inputs at least this large are split across threads by countFrequencies
+constexpr size_t PARALLEL_HISTOGRAM_MIN_SIZE = 4u << 20;
+
+// Count the occurrences of every byte value in data[0, size) into
+// `frequencies` (overwritten). Several interleaved count arrays keep
+// repeated symbols from stalling on one counter; the widest kernel the CPU
+// supports (AVX2, SSE2 or scalar) is chosen at run time. With threads > 1,
+// inputs of PARALLEL_HISTOGRAM_MIN_SIZE bytes or more are split into one
+// slice per thread. size must be below 4 GiB.
+void countFrequencies(const ORIGINAL_DATA_TYPE* data, size_t size, FrequencyTable& frequencies,
+                      unsigned threads = 1);
+
+// Shannon bound for the counted data in bytes: what an ideal order-0 code
+// would need, before any code table. Huffman codes never do better.
+uint64_t entropyBytes(const FrequencyTable& frequencies);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,64 @@
+// include/HuffmanDecodeTable.h
+#ifndef HUFFMANDECODETABLE_H
+#define HUFFMANDECODETABLE_H
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "HuffmanTree.h"
+#include "Format.h"
+
+// Multi-symbol lookup table for canonical Huffman decoding.
+// The next LOOKUP_BITS bits of the stream index an entry that holds every
+// whole symbol (up to MAX_SYMBOLS_PER_ENTRY) whose code lies entirely inside
+// those bits. Entries with symbolCount == 0 start with a code longer than
+// LOOKUP_BITS (or an invalid prefix) and are resolved with decodeLong().
+class HuffmanDecodeTable {
+public:
+    static constexpr int LOOKUP_BITS = 11;
+    static constexpr int MAX_SYMBOLS_PER_ENTRY = 4;
+
+    struct Entry {
+        ORIGINAL_DATA_TYPE symbols[MAX_SYMBOLS_PER_ENTRY];
+        uint8_t symbolCount;
+        uint8_t bitLength; // Total bits consumed by all symbols in the entry
+    };
+
+    // Build the table for codeLengths; does nothing when it was last built
+    // for the same lengths
+    void build(const CodeLengthTable& codeLengths);
+
+    const Entry& lookup(uint32_t index) const {
+        return entries[index];
+    }
+
+    // Resolve a code longer than LOOKUP_BITS from the next MAX_CODE_LENGTH_LIMIT
+    // bits of the stream. Returns the code length, or 0 if the bits do not
+    // start a valid code.
+    int decodeLong(uint32_t bits, ORIGINAL_DATA_TYPE& symbol) const {
+        for (int len = LOOKUP_BITS + 1; len <= maxLength; ++len) {
+            uint32_t offset = (bits >> (MAX_CODE_LENGTH_LIMIT - len)) - firstCode[len];
+            if (offset < lengthCount[len]) {
+                symbol = sortedSymbols[firstIndex[len] + offset];
+                return len;
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::vector<Entry> entries;
+
+    // Canonical code ranges, indexed by code length
+    int maxLength = 0;
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 1> firstCode{};
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 1> lengthCount{};
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 1> firstIndex{};
+    std::array<ORIGINAL_DATA_TYPE, 256> sortedSymbols{};
+
+    // Lengths of the last successful build
+    bool built = false;
+    CodeLengthTable builtLengths{};
+};
+
+#endif // HUFFMANDECODETABLE_H
@@ -1,14 +1,176 @@
-// include/HuffmanDecoder.h
-#ifndef HUFFMANDECODER_H
-#define HUFFMANDECODER_H
-
-#include <string>
-#include "HuffmanTree.h"
-#include "BitIO.h"
-
-class HuffmanDecoder {
-public:
-    void decompress(const std::string& inputPath, const std::string& outputPath);
-};
-
-#endif // HUFFMANDECODER_H
+// include/HuffmanDecoder.h
+#ifndef HUFFMANDECODER_H
+#define HUFFMANDECODER_H
+
+#include <string>
+#include <vector>
+#include "HuffmanTree.h"
+#include "HuffmanDecodeTable.h"
+#include "BitIO.h"
+#include "Format.h"
+#include "MappedFile.h"
+#include "Utils.h"
+#include "Stats.h"
+#include "SharedTable.h"
+#include <istream>
+#include <memory>
+
+struct DecoderOptions {
+    // Worker threads; 0 uses one per hardware core
+    unsigned threads = 0;
+    // Print timing and size statistics to standard error
+    StatsFormat stats = StatsFormat::None;
+    // Table for data compressed with a shared table; must match its ID
+    std::shared_ptr<const SharedTable> table;
+};
+
+// Like the encoder, a decoder keeps its decode table and block index between
+// calls to the buffer functions; use one instance per thread.
+class HuffmanDecoder {
+public:
+    explicit HuffmanDecoder(const DecoderOptions& options = DecoderOptions());
+    void decompress(const std::string& inputPath, const std::string& outputPath);
+    // Decode everything and check the block and whole-data checksums without
+    // writing any output; throws on the first mismatch
+    void test(const std::string& inputPath);
+    // Write bytes [offset, offset + length) of the original data to outputPath,
+    // decoding only the blocks that cover the range
+    void extract(const std::string& inputPath, const std::string& outputPath, uint64_t offset, uint64_t length);
+    // Return bytes [offset, offset + length) of the original data; the range
+    // is cut off at the end of the data
+    std::vector<ORIGINAL_DATA_TYPE> readRange(const std::string& inputPath, uint64_t offset, uint64_t length);
+    // Extract the files of an archive under outputDir, decoding its blocks in
+    // parallel; with `names`, only those files, decoding only their blocks
+    void extractArchive(const std::string& archivePath, const std::string& outputDir,
+                        const std::vector<std::string>& names = {});
+
+    // Original size of the data in a compressed buffer
+    static uint64_t decompressedSize(const uint8_t* src, size_t srcSize);
+    // Decompress a buffer into dst and return the original size; throws
+    // std::length_error when dstCapacity is too small
+    size_t decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity);
+    // Decompress a buffer, replacing the contents of dst
+    void decompress(const uint8_t* src, size_t srcSize, std::vector<ORIGINAL_DATA_TYPE>& dst);
+    // Phase times of the last buffer decompression
+    const DecoderPhaseTimes& lastPhaseTimes() const { return phaseTimes; }
+
+private:
+    // What the file header and trailer say about the block index
+    struct IndexLocation {
+        uint32_t blockSize;
+        uint32_t tableId;
+        uint64_t dedupWindow; // 0 unless the file may hold reference blocks
+        uint64_t blockCount;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+        uint32_t checksum;
+    };
+
+    DecoderOptions options;
+    HuffmanDecodeTable decodeTable;
+    std::vector<BlockIndexEntry> bufferIndex;
+    DecoderPhaseTimes phaseTimes;
+
+    // Decoded block (empty when it was already stored in place), its
+    // checksum and the time it took. A reference block is left to the
+    // in-order stage, with the distance to the block it repeats.
+    struct DecodedBlock {
+        std::vector<ORIGINAL_DATA_TYPE> bytes;
+        uint32_t checksum = 0;
+        uint64_t reference = 0;
+        DecoderPhaseTimes times;
+    };
+
+    // One block on its way through the streaming pipeline; the buffers and
+    // the decode table are reused for later blocks
+    struct StreamBlock {
+        std::vector<uint8_t> payload;
+        uint32_t rawSize = 0;
+        uint32_t checksum = 0;
+        bool reusesTable = false;
+        CodeLengthTable recentTable{}; // Code lengths the block reuses
+        HuffmanDecodeTable decodeTable;
+        DecodedBlock decoded;
+    };
+
+    // Open inputPath and decode it to outputPath ("-" for the standard
+    // streams), or only check it when outputPath is empty. Archives can only
+    // be checked, their directory included.
+    void decodeFile(const std::string& inputPath, const std::string& outputPath, RunStats& stats);
+    // Decode the first fileSize bytes of a seekable file through their block
+    // index, in parallel, to outputFd, or only check them when it is -1
+    void decompressIndexed(const FileDescriptor& inputFile, uint64_t fileSize, const std::string& inputPath,
+                           int outputFd, const std::string& outputPath, RunStats& stats);
+    // Decode a stream front to back without seeking
+    void decompressStream(std::istream& inputStream, const std::string& inputPath, int outputFd, RunStats& stats);
+
+    // Validate the file header and set the block size, shared table ID and
+    // dedup window in `location`
+    static void parseFileHeader(const uint8_t* fileHeader, const std::string& inputPath, IndexLocation& location);
+    // Validate the file header and read the block index from the end of the file
+    static std::vector<BlockIndexEntry> readBlockIndex(int fd, uint64_t fileSize, const std::string& inputPath,
+                                                       IndexLocation& location);
+    // Decode table of the shared table a file names; null for tableId 0.
+    // Throws unless options.table is that table.
+    const HuffmanDecodeTable* sharedDecodeTable(uint32_t tableId) const;
+    // Validate the file header and the trailer of a fileSize-byte file
+    static IndexLocation parseTrailer(const uint8_t* fileHeader, const uint8_t* trailer, uint64_t fileSize,
+                                      const std::string& inputPath);
+    static void parseIndexEntries(const uint8_t* indexBytes, const IndexLocation& location,
+                                  std::vector<BlockIndexEntry>& blockIndex);
+    // Validate the header, trailer and block index of a compressed buffer
+    static IndexLocation parseBufferIndex(const uint8_t* src, size_t srcSize,
+                                          std::vector<BlockIndexEntry>& blockIndex);
+    // Decode the blocks of bufferIndex, parsed from src, into dst, which
+    // has room for all of them, and check the trailer checksum
+    void decodeBuffer(const uint8_t* src, const IndexLocation& location, uint8_t* dst);
+    // Fetch block `number` (from `input` when the whole file is in memory),
+    // check it and decode it into `output`. Sets the checksum and reference
+    // distance of `block` and adds to its times; a reference block is not
+    // decoded.
+    static void decodeIndexedBlock(int fd, const uint8_t* input, const std::vector<BlockIndexEntry>& blockIndex,
+                                   size_t number, uint64_t dedupWindow, HuffmanDecodeTable& decodeTable,
+                                   const HuffmanDecodeTable* sharedTable, ORIGINAL_DATA_TYPE* output,
+                                   DecodedBlock& block);
+    // Code lengths of the block `distance` blocks before block `number`,
+    // read from its payload; throws unless it has code lengths of its own
+    static CodeLengthTable fetchRecentTable(int fd, const uint8_t* input, const std::vector<BlockIndexEntry>& blockIndex,
+                                            size_t number, uint64_t distance);
+    // Decode block `number` into `output`, decoding the block a reference
+    // block repeats in its place; for readers that skip blocks. Returns the
+    // checksum.
+    static uint32_t decodeIndexedBlockAt(int fd, const uint8_t* input, const std::vector<BlockIndexEntry>& blockIndex,
+                                         size_t number, uint64_t dedupWindow, HuffmanDecodeTable& decodeTable,
+                                         const HuffmanDecodeTable* sharedTable, ORIGINAL_DATA_TYPE* output,
+                                         DecoderPhaseTimes& times);
+    // Distance back to the block a BLOCK_MODE_REFERENCE payload repeats, 0
+    // for other blocks; throws unless it is within dedupWindow
+    static uint64_t referenceDistance(const uint8_t* payload, size_t payloadSize, uint64_t dedupWindow);
+    // Distance back to the block whose code table a payload reuses, 0 for
+    // blocks that do not; throws unless it is within RECENT_TABLE_WINDOW
+    static uint64_t recentTableDistance(const uint8_t* payload, size_t payloadSize);
+    // Read the code lengths of a Huffman payload that carries its own;
+    // returns false for every other block
+    static bool ownCodeLengths(const uint8_t* payload, size_t payloadSize, CodeLengthTable& codeLengths);
+    // Decode one block payload (code lengths and encoded data) into the
+    // rawSize bytes at `output` and check them against `checksum`; the time
+    // spent is added to `times`. Blocks coded with the shared table use
+    // sharedTable; others build decodeTable, from recentTable for blocks
+    // that reuse the table of an earlier block.
+    static void decodeBlock(const uint8_t* payload, size_t payloadSize, uint32_t rawSize, uint32_t checksum,
+                            HuffmanDecodeTable& decodeTable, const HuffmanDecodeTable* sharedTable,
+                            const CodeLengthTable* recentTable, ORIGINAL_DATA_TYPE* output,
+                            DecoderPhaseTimes& times);
+    // Throw unless data[0, size) has the given checksum
+    static void verifyChecksum(const ORIGINAL_DATA_TYPE* data, uint32_t size, uint32_t checksum,
+                               DecoderPhaseTimes& times);
+    static void decodeData(BitReader& bitReader, uint32_t totalChars, const HuffmanDecodeTable& decodeTable,
+                           ORIGINAL_DATA_TYPE* output);
+    // Decode the jump table and four sub-streams of a BLOCK_MODE_FOUR_STREAMS
+    // block, running the streams in lockstep
+    static void decodeFourStreams(const uint8_t* data, size_t dataSize, uint32_t rawSize,
+                                  const HuffmanDecodeTable& decodeTable, ORIGINAL_DATA_TYPE* output);
+    static CodeLengthTable readCodeLengths(const uint8_t*& cur, const uint8_t* end);
+};
+
+#endif // HUFFMANDECODER_H
@@ -1,16 +1,243 @@
-// include/HuffmanEncoder.h
-#ifndef HUFFMANENCODER_H
-#define HUFFMANENCODER_H
-
-#include <string>
-#include "HuffmanTree.h"
-
-class HuffmanEncoder {
-public:
-    void compress(const std::string& inputPath, const std::string& outputPath);
-
-private:
-    std::vector<uint8_t> packBits(const std::vector<bool>& bits);
-};
-
-#endif // HUFFMANENCODER_H
+// include/HuffmanEncoder.h
+#ifndef HUFFMANENCODER_H
+#define HUFFMANENCODER_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <ostream>
+#include "HuffmanTree.h"
+#include "Format.h"
+#include "Stats.h"
+#include "SharedTable.h"
+#include "RecentTables.h"
+#include "TansCoder.h"
+#include <memory>
+#include <functional>
+
+// Single-stream blocks at least this large are coded by several threads when
+// the block may use more than one
+constexpr size_t PARALLEL_ENCODE_MIN_SIZE = 512u << 10;
+
+// Codes of two consecutive symbols, indexed by (first << 8) | second: the
+// first code followed by the second, and their combined length. Codes have
+// at most MAX_CODE_LENGTH_LIMIT bits, so every pair fits one writeBits call.
+struct PairCode {
+    uint32_t code;
+    uint32_t length;
+};
+using PairCodeTable = std::vector<PairCode>;
+constexpr size_t PAIR_TABLE_SIZE = 256 * 256;
+static_assert(2 * MAX_CODE_LENGTH_LIMIT <= 32, "a pair of codes must fit one BitWriter::writeBits call");
+
+// Blocks whose estimated Huffman coding saves less than 1/STORED_BLOCK_DIVISOR
+// of their size are stored raw; they then decode as a plain copy
+constexpr size_t STORED_BLOCK_DIVISOR = 32;
+
+// With a shared table, blocks below this size always use it: their own code
+// table would cost more than it could save
+constexpr size_t OWN_TABLE_MIN_SIZE = 64u << 10;
+
+// A block reuses a recent code table when that costs at most
+// 1/TABLE_REUSE_DIVISOR more than the estimate for a table of its own;
+// only once the statistics drift further is a new table built and stored
+constexpr uint64_t TABLE_REUSE_DIVISOR = 256;
+
+// Smaller blocks are never deduplicated; the reference must stay below the
+// raw size, and such blocks code to a few bytes anyway
+constexpr size_t DEDUP_MIN_BLOCK_SIZE = 64;
+
+// In automatic mode a block is coded with tANS when the estimate beats the
+// Huffman payload by more than 1/TANS_MIN_GAIN_DIVISOR of it; closer calls
+// keep the Huffman code, which encodes faster and may be reused
+constexpr uint64_t TANS_MIN_GAIN_DIVISOR = 128;
+
+// Entropy coder of the blocks that are neither stored, runs nor references
+enum class EntropyCoder {
+    Auto,    // Per block, whichever codes it smaller
+    Huffman,
+    Tans
+};
+
+struct EncoderOptions {
+    // Upper bound for code lengths, between MIN_CODE_LENGTH_LIMIT and MAX_CODE_LENGTH_LIMIT
+    int maxCodeLength = DEFAULT_MAX_CODE_LENGTH;
+    // Input bytes per independently coded block
+    uint32_t blockSize = DEFAULT_BLOCK_SIZE;
+    // Bit streams per block: STREAM_COUNT decodes faster, 1 keeps the plain
+    // single-stream layout
+    int streams = STREAM_COUNT;
+    // Worker threads; 0 uses one per hardware core
+    unsigned threads = 0;
+    // Print the symbol frequencies and a size summary after compressing
+    bool verbose = false;
+    // Print timing and size statistics to standard error
+    StatsFormat stats = StatsFormat::None;
+    // Trained code table used instead of per-block tables where it codes no
+    // worse; decoding then needs the same table
+    std::shared_ptr<const SharedTable> table;
+    // Fingerprint every block and store one that repeats a block of the
+    // last DEDUP_WINDOW_SIZE bytes as a reference to it instead of coding it
+    bool dedup = false;
+    // Entropy coder; Auto picks tANS for the blocks whose skewed statistics
+    // leave Huffman codes well above the entropy
+    EntropyCoder coder = EntropyCoder::Auto;
+};
+
+// An encoder keeps its working buffers between calls, so one instance can be
+// reused for many small in-memory messages without reallocating. The buffer
+// functions print nothing and only start helper threads to count and code
+// very large blocks; use one instance per thread.
+class HuffmanEncoder {
+public:
+    explicit HuffmanEncoder(const EncoderOptions& options = EncoderOptions());
+    void compress(const std::string& inputPath, const std::string& outputPath);
+    // Compress every regular file under inputDir into one archive (see
+    // Format.h); archivePath may be "-" for standard output
+    void compressArchive(const std::string& inputDir, const std::string& archivePath);
+
+    // Largest compressed size of srcSize input bytes
+    static size_t compressBound(size_t srcSize, uint32_t blockSize = DEFAULT_BLOCK_SIZE);
+    // Compress a buffer into dst and return the compressed size; throws
+    // std::length_error when dstCapacity is too small
+    size_t compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity);
+    // Compress a buffer, replacing the contents of dst
+    void compress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst);
+    // Phase times of the last buffer compression
+    const EncoderPhaseTimes& lastPhaseTimes() const { return phaseTimes; }
+
+private:
+    // Histogram, checksum, tree, pair codes, tANS table and sub-stream
+    // buffers of the block being coded
+    struct BlockScratch {
+        FrequencyTable frequencies;
+        uint32_t checksum = 0;
+        bool reusedTable = false;
+        bool tans = false;
+        HuffmanTree tree;
+        PairCodeTable pairCodes;   // Empty until first needed
+        CodeTable pairSource{};    // Code table pairCodes was built from
+        NormalizedCounts tansCounts;
+        TansEncodeTable tansTable;
+        std::array<std::vector<uint8_t>, STREAM_COUNT> streams;
+    };
+
+    // Serialized block (header, code lengths and data) plus its statistics
+    struct EncodedBlock {
+        std::vector<uint8_t> bytes;
+        uint32_t rawSize = 0;
+        uint32_t checksum = 0;
+        bool reusedTable = false;
+        bool tans = false;
+        FrequencyTable frequencies;
+        size_t tableSize = 0;
+        EncoderPhaseTimes times;
+    };
+
+    EncoderOptions options;
+    BlockScratch scratch;
+    std::vector<uint8_t> buffer;
+    std::vector<BlockIndexEntry> bufferIndex;
+    EncoderPhaseTimes phaseTimes;
+
+    // One block on its way through the compression pipeline; the buffers
+    // are reused for later blocks
+    struct PipelineBlock {
+        std::vector<ORIGINAL_DATA_TYPE> input; // Unused when the input is mapped
+        const ORIGINAL_DATA_TYPE* data = nullptr;
+        size_t size = 0;
+        uint64_t number = 0;
+        uint64_t reference = 0; // Distance to the block it repeats, 0 for none
+        BlockScratch scratch;
+        EncodedBlock encoded;
+    };
+
+    // Fills a PipelineBlock with the next input block; false at the end
+    using BlockReader = std::function<bool(PipelineBlock&)>;
+
+    // Symbol counts and header bytes of a compressed stream, for --verbose
+    struct StreamSummary {
+        FrequencyTotals frequencies{};
+        uint64_t headerSize = 0;
+    };
+
+    // Write the file header, the blocks `read` provides, coded by the
+    // reader, coder and writer pipeline, and the footer to `output`. Sets the
+    // sizes, block counts, thread count and times in `stats`. With
+    // options.dedup the reader fingerprints each block, and repeats skip the
+    // coder. Blocks choose among the recent code tables in order.
+    void writeStream(std::ostream& output, const std::string& outputPath, const BlockReader& read,
+                     unsigned blockThreads, RunStats& stats, StreamSummary& summary) const;
+
+    // Code block `number`, data[0, size), into `block`, reusing its buffer
+    void encodeBlock(EncodedBlock& block, BlockScratch& blockScratch, const ORIGINAL_DATA_TYPE* data, size_t size,
+                     RecentTables& recentTables, uint64_t number, unsigned threads = 1) const;
+    // Code data[0, size) as a reference to the block `distance` blocks back
+    void encodeReference(EncodedBlock& block, const ORIGINAL_DATA_TYPE* data, size_t size, uint64_t distance) const;
+    // Append block `number` to out, coded, and return the size of its code
+    // table; its checksum is left in blockScratch.checksum and the time spent
+    // is added to `times`. The block takes its turn in recentTables, which
+    // may give it a table to reuse. Large blocks are counted, and in
+    // single-stream mode coded, with up to `threads` threads.
+    size_t appendBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                       BlockScratch& blockScratch, EncoderPhaseTimes& times, RecentTables& recentTables,
+                       uint64_t number, unsigned threads = 1) const;
+    // BLOCK_MODE_RLE for single-symbol blocks, BLOCK_MODE_STORED when the
+    // entropy estimate says coding does not pay, otherwise a Huffman mode,
+    // with BLOCK_MODE_SHARED_TABLE set when `table` is the better choice.
+    // Sets `entropy` to the entropyBytes estimate for the Huffman modes
+    // without the shared table.
+    static uint8_t chooseBlockMode(const FrequencyTable& frequencies, size_t size, const SharedTable* table,
+                                   uint64_t& entropy);
+    // The table of `tables` that codes a block `number` with these
+    // frequencies in the fewest bytes, if that is within TABLE_REUSE_DIVISOR
+    // of a table of its own and fits the payload bound; null otherwise
+    static const RecentTable* chooseRecentTable(const FrequencyTable& frequencies, size_t size, uint64_t entropy,
+                                                uint64_t number, const RecentTables::Tables& tables,
+                                                bool fourStreams);
+    // Coded size of a block in bits, or UINT64_MAX when codeTable has no code
+    // for one of its symbols
+    static uint64_t codedBits(const FrequencyTable& frequencies, const CodeTable& codeTable);
+    // Largest payload of a Huffman block with codeBits of data and
+    // tableSize bytes between the mode byte and the data
+    static uint64_t huffmanPayloadBound(uint64_t bits, size_t tableSize, bool fourStreams);
+    // Whether to code a block with tANS rather than with `bits` of Huffman
+    // codes in a payload of at most huffmanPayload bytes; leaves the counts
+    // and table log to code it with in blockScratch
+    bool chooseTans(const FrequencyTable& frequencies, size_t size, uint64_t entropy, uint64_t bits,
+                    uint64_t huffmanPayload, BlockScratch& blockScratch, int& tableLog) const;
+    // Append a BLOCK_MODE_TANS block coded with the counts in blockScratch
+    static void appendTansBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                uint32_t checksum, BlockScratch& blockScratch, int tableLog);
+    // Copy a block into out as stored and return its checksum
+    static uint32_t appendStoredBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size);
+    static void appendRleBlock(std::vector<uint8_t>& out, ORIGINAL_DATA_TYPE symbol, size_t size,
+                               uint32_t checksum);
+    static void appendReferenceBlock(std::vector<uint8_t>& out, size_t size, uint64_t distance, uint32_t checksum);
+    void appendFileHeader(std::vector<uint8_t>& out) const;
+    // Symbol frequencies and sizes, printed with --verbose
+    static void printSummary(std::ostream& out, const FrequencyTotals& frequencies, const RunStats& stats,
+                             uint64_t headerSize);
+    // End marker, block index and trailer; blocks end at compressedOffset
+    // and checksum covers all of their data
+    static void appendFooter(std::vector<uint8_t>& out, const std::vector<BlockIndexEntry>& blockIndex,
+                             uint64_t compressedOffset, uint32_t checksum);
+    static void writeCodeLengths(std::vector<uint8_t>& out, const CodeLengthTable& codeLengths);
+    // Pair codes of codeTable, kept in blockScratch, for coding `size`
+    // symbols; null when filling them would cost more than they save. Only
+    // pairs of symbols that have a code are filled in.
+    static const PairCodeTable* pairCodesFor(const CodeTable& codeTable, size_t size, BlockScratch& blockScratch);
+    // Single bit stream; two symbols per step with pairCodes, if not null
+    static void writeSingleStream(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                  const CodeTable& codeTable, const PairCodeTable* pairCodes);
+    // Single bit stream coded in one chunk per thread; the bytes are the same
+    // as from a sequential BitWriter
+    static void writeStreamParallel(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                    const CodeTable& codeTable, const PairCodeTable* pairCodes, unsigned threads);
+    // Jump table and the four sub-streams of a BLOCK_MODE_FOUR_STREAMS block
+    static void writeFourStreams(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                 const CodeTable& codeTable, const PairCodeTable* pairCodes,
+                                 BlockScratch& blockScratch);
+};
+
+#endif // HUFFMANENCODER_H
@@ -1,44 +1,61 @@
-// include/HuffmanTree.h
-#ifndef HUFFMANTREE_H
-#define HUFFMANTREE_H
-
-#include <unordered_map>
-#include <vector>
-#include <memory>
-#include <functional>
-#include <cstdint>
-
-using ORIGINAL_DATA_TYPE = unsigned char;
-
-struct VectorBoolHash {
-    std::size_t operator()(const std::vector<bool>& v) const;
-};
-
-struct HuffmanNode {
-    ORIGINAL_DATA_TYPE character;
-    int frequency;
-    std::shared_ptr<HuffmanNode> left;
-    std::shared_ptr<HuffmanNode> right;
-
-    HuffmanNode(ORIGINAL_DATA_TYPE ch, int freq);
-    bool isLeaf() const;
-};
-
-struct CompareNode {
-    bool operator()(const std::shared_ptr<HuffmanNode>& a, const std::shared_ptr<HuffmanNode>& b) const;
-};
-
-class HuffmanTree {
-public:
-    std::shared_ptr<HuffmanNode> root;
-    std::unordered_map<ORIGINAL_DATA_TYPE, std::vector<bool>> codeTable;
-
-    void buildTree(const std::unordered_map<ORIGINAL_DATA_TYPE, int>& frequencyMap);
-    void buildTreeFromCodeTable(const std::unordered_map<std::vector<bool>, ORIGINAL_DATA_TYPE, VectorBoolHash>& inverseCodeTable);
-    void generateCodeTable();
-
-private:
-    void traverse(const std::shared_ptr<HuffmanNode>& node, std::vector<bool>& currentCode);
-};
-
-#endif // HUFFMANTREE_H
+// include/HuffmanTree.h
+#ifndef HUFFMANTREE_H
+#define HUFFMANTREE_H
+
+#include <array>
+#include <cstdint>
+
+using ORIGINAL_DATA_TYPE = unsigned char;
+
+// Occurrence count per symbol value
+using FrequencyTable = std::array<uint32_t, 256>;
+
+// Counts summed over many blocks or files; may exceed 32 bits
+using FrequencyTotals = std::array<uint64_t, 256>;
+
+// Code length per symbol value, 0 for symbols that do not occur
+using CodeLengthTable = std::array<uint8_t, 256>;
+
+// Canonical code of one symbol, most significant bit first
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t length;
+};
+
+using CodeTable = std::array<HuffmanCode, 256>;
+
+// Nodes live in one array and refer to their children by index. Leaves come
+// first; every internal node is stored after both of its children.
+struct HuffmanNode {
+    uint64_t frequency;
+    int16_t left;   // -1 for leaves
+    int16_t right;  // -1 for leaves and for the parent of a lone symbol
+    ORIGINAL_DATA_TYPE character;
+
+    bool isLeaf() const { return left < 0; }
+};
+
+class HuffmanTree {
+public:
+    // 256 leaves and 255 internal nodes
+    static constexpr int MAX_NODES = 511;
+
+    std::array<HuffmanNode, MAX_NODES> nodes;
+    int leafCount = 0;
+    int nodeCount = 0;
+    int root = -1;
+    CodeTable codeTable{};
+    CodeLengthTable codeLengths{};
+
+    // Build the tree without allocating: sort the leaves by frequency, then
+    // merge them with a two-queue scan (leaves and internal nodes are each
+    // produced in increasing frequency order)
+    void buildTree(const FrequencyTable& frequencies);
+    // Derive code lengths from the tree, limit them to maxCodeLength and
+    // assign canonical codes
+    void generateCodeTable(int maxCodeLength);
+    // Assign canonical codes to previously stored code lengths
+    void generateCodeTableFromLengths(const CodeLengthTable& lengths);
+};
+
+#endif // HUFFMANTREE_H
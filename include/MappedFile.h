@@ -0,0 +1,34 @@
+// include/MappedFile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <memory>
+#include <cstdint>
+
+// Memory mapping of the first `size` bytes of an open file. Writable
+// mappings are shared, so stores go straight to the file.
+class MappedFile {
+public:
+    // Returns nullptr when the descriptor cannot be mapped (not a regular
+    // file, empty range, or mmap failure); callers fall back to buffered I/O
+    static std::unique_ptr<MappedFile> tryMap(int fd, uint64_t size, bool writable);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() const { return address; }
+    uint64_t size() const { return length; }
+
+    // Tell the kernel the mapping will be read front to back
+    void adviseSequential() const;
+
+private:
+    MappedFile(uint8_t* address, uint64_t length);
+
+    uint8_t* address;
+    uint64_t length;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,54 @@
+// include/RecentTables.h
+#ifndef RECENTTABLES_H
+#define RECENTTABLES_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "HuffmanTree.h"
+
+// Code tables a block may choose from, bzip2 style: the newest ones built
+// by earlier blocks of the stream
+constexpr size_t RECENT_TABLE_COUNT = 4;
+
+// Code table built by an earlier block, for later blocks to reuse
+struct RecentTable {
+    uint64_t block = 0;
+    CodeLengthTable codeLengths{};
+    CodeTable codeTable{};
+    // Bits per symbol the table spent above the entropy of its own block;
+    // a fresh table for similar data would do about as well
+    double excessBits = 0;
+};
+
+// The recent tables of a stream, handed from block to block in order.
+// Every block n calls tablesFor(n) and then publish(n, ...). tablesFor waits
+// until block n - 1 has published, so the tables a block sees, and with them
+// the output, do not depend on the number of coders. Blocks publish as soon
+// as their table is chosen, before coding, so the wait is short.
+class RecentTables {
+public:
+    using Tables = std::vector<std::shared_ptr<const RecentTable>>;
+
+    // Tables block `number` may reuse, newest first
+    Tables tablesFor(uint64_t number);
+    // Record the table block `number` built, or null when it built none,
+    // and let block number + 1 go ahead
+    void publish(uint64_t number, std::shared_ptr<const RecentTable> table);
+    // Make every waiting and later tablesFor call throw `failure`; for
+    // pipelines where a stage failed and some blocks will never publish
+    void abort(std::exception_ptr failure);
+
+private:
+    std::mutex mutex;
+    std::condition_variable publishedCondition;
+    uint64_t nextBlock = 0;
+    std::exception_ptr error;
+    Tables tables;
+};
+
+#endif // RECENTTABLES_H
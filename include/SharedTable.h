@@ -0,0 +1,37 @@
+// include/SharedTable.h
+#ifndef SHAREDTABLE_H
+#define SHAREDTABLE_H
+
+#include <string>
+#include <vector>
+#include "HuffmanTree.h"
+#include "HuffmanDecodeTable.h"
+
+// Code lengths trained on sample data and shared by many compressed files,
+// so that small inputs need neither a code table of their own nor a tree
+// build. Every byte value has a code, so any input can be coded with it.
+// Files name the table by its ID, a hash of the code lengths.
+class SharedTable {
+public:
+    // Train on the sample files; directories are searched recursively
+    static SharedTable train(const std::vector<std::string>& samplePaths, int maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
+    // Build from symbol counts; symbols that never occur still get a code
+    static SharedTable fromFrequencies(const FrequencyTotals& frequencies,
+                                       int maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
+    static SharedTable load(const std::string& path);
+    void save(const std::string& path) const;
+
+    uint32_t id() const { return tableId; }
+    const CodeLengthTable& codeLengths() const { return tree.codeLengths; }
+    const CodeTable& codeTable() const { return tree.codeTable; }
+    const HuffmanDecodeTable& decodeTable() const { return decoder; }
+
+private:
+    explicit SharedTable(const CodeLengthTable& codeLengths);
+
+    uint32_t tableId = 0;
+    HuffmanTree tree;
+    HuffmanDecodeTable decoder;
+};
+
+#endif // SHAREDTABLE_H
@@ -0,0 +1,140 @@
+// include/SpscRing.h
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lets a thread sleep until another one signals progress. notify() costs one
+// atomic load while nobody sleeps; the mutex is only taken on the slow path.
+class WaitSignal {
+public:
+    // Wait until ready() holds; returns false once `cancelled` is set instead
+    template <typename Ready>
+    bool wait(Ready ready, const std::atomic<bool>& cancelled) {
+        // Neighbouring stages usually catch up within a few time slices
+        for (int spin = 0; spin < SPIN_COUNT; ++spin) {
+            if (ready()) {
+                return true;
+            }
+            if (cancelled.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        // Pairs with the fence in notify(): either the waker sees the
+        // sleeper, or the sleeper sees the waker's update
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready() && !cancelled.load()) {
+            condition.wait(lock);
+        }
+        sleepers.fetch_sub(1);
+        return !cancelled.load() || ready();
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) > 0) {
+            wakeAll();
+        }
+    }
+
+    void wakeAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+
+private:
+    static constexpr int SPIN_COUNT = 64;
+
+    std::atomic<int> sleepers{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+// Bounded queue between exactly one producer and one consumer thread. The
+// indices only ever grow; each side owns one of them, so handing over an
+// element takes no lock.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots(capacity == 0 ? 1 : capacity) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    bool tryPush(const T& value) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[tail % slots.size()] = value;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        notEmpty.notify();
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (tailIndex.load(std::memory_order_acquire) == head) {
+            return false;
+        }
+        value = slots[head % slots.size()];
+        headIndex.store(head + 1, std::memory_order_release);
+        notFull.notify();
+        return true;
+    }
+
+    // Blocking versions; they return false when `cancelled` is set while
+    // waiting. Every wait is counted in `stalls`.
+    bool push(const T& value, const std::atomic<bool>& cancelled, uint64_t& stalls) {
+        while (!tryPush(value)) {
+            ++stalls;
+            if (!notFull.wait([this]() { return !full(); }, cancelled)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool pop(T& value, const std::atomic<bool>& cancelled, uint64_t& stalls) {
+        while (!tryPop(value)) {
+            ++stalls;
+            if (!notEmpty.wait([this]() { return !empty(); }, cancelled)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Wake both sides so they notice cancellation
+    void wakeAll() {
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+private:
+    bool empty() const {
+        return tailIndex.load(std::memory_order_acquire) == headIndex.load(std::memory_order_acquire);
+    }
+
+    bool full() const {
+        return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire) == slots.size();
+    }
+
+    std::vector<T> slots;
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    alignas(64) std::atomic<size_t> headIndex{0};
+    WaitSignal notEmpty;
+    WaitSignal notFull;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,92 @@
+// include/Stats.h
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+using StatsClock = std::chrono::steady_clock;
+
+// Seconds since `start`; moves `start` to now so consecutive calls time
+// consecutive phases
+inline double lapSeconds(StatsClock::time_point& start) {
+    StatsClock::time_point now = StatsClock::now();
+    double seconds = std::chrono::duration<double>(now - start).count();
+    start = now;
+    return seconds;
+}
+
+// Time spent in each phase of block encoding, summed over blocks
+struct EncoderPhaseTimes {
+    double histogram = 0;
+    double checksum = 0;
+    double tree = 0;
+    double header = 0;
+    double encode = 0;
+
+    EncoderPhaseTimes& operator+=(const EncoderPhaseTimes& other) {
+        histogram += other.histogram;
+        checksum += other.checksum;
+        tree += other.tree;
+        header += other.header;
+        encode += other.encode;
+        return *this;
+    }
+};
+
+// Time spent in each phase of block decoding, summed over blocks
+struct DecoderPhaseTimes {
+    double table = 0;
+    double decode = 0;
+    double checksum = 0;
+
+    DecoderPhaseTimes& operator+=(const DecoderPhaseTimes& other) {
+        table += other.table;
+        decode += other.decode;
+        checksum += other.checksum;
+        return *this;
+    }
+};
+
+// How often each stage of a BlockPipeline had to wait for a neighbour
+struct PipelineStalls {
+    uint64_t reader = 0;    // no free buffer or coder queue full: coding or output is behind
+    uint64_t coder = 0;     // no block to code: input is behind
+    uint64_t writer = 0;    // next block not coded yet
+    double writerWait = 0;  // seconds the writer spent in those waits
+};
+
+// Output of --stats
+enum class StatsFormat {
+    None,
+    Text,
+    Json
+};
+
+// Figures for one compress or decompress run. Phase times are summed over
+// the worker threads; the rest is wall time on the reading and writing
+// threads.
+struct RunStats {
+    const char* operation = "";
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t blocks = 0;
+    uint64_t dedupBlocks = 0; // blocks stored as references to earlier ones
+    uint64_t reusedTables = 0; // blocks coded with an earlier block's table
+    uint64_t tansBlocks = 0;   // blocks coded with tANS instead of Huffman
+    unsigned threads = 0;
+    double wall = 0;
+    double read = 0;    // reading input
+    double write = 0;   // writing output
+    double wait = 0;    // waiting for the next block from the workers
+    double flush = 0;   // footer and final flush
+    double dedup = 0;   // fingerprinting blocks on the reading thread
+    PipelineStalls stalls;
+    EncoderPhaseTimes encoder;
+    DecoderPhaseTimes decoder;
+};
+
+void printStats(std::ostream& out, const RunStats& stats, StatsFormat format);
+
+#endif // STATS_H
@@ -0,0 +1,78 @@
+// include/TansCoder.h
+#ifndef TANSCODER_H
+#define TANSCODER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "HuffmanTree.h"
+#include "Format.h"
+
+// Table-based asymmetric numeral systems (tANS), the second entropy coder
+// next to Huffman. Symbol counts are scaled to a table of 1 << tableLog
+// states; a symbol with normalized count n costs about tableLog - log2(n)
+// bits, a fraction of a bit where a Huffman code needs a whole one.
+//
+// TANS_STATE_COUNT states take turns, symbol i going through state
+// i % TANS_STATE_COUNT, so the decoder has that many independent chains of
+// table lookups to overlap. The encoder runs
+// from the last symbol to the first and appends bits least significant bit
+// first; the decoder reads them back from the end of the stream.
+
+// Normalized count per symbol value, summing to 1 << tableLog; 0 for
+// symbols that do not occur
+using NormalizedCounts = std::array<uint16_t, 256>;
+
+// Table size for a block of `size` bytes with symbolCount symbols: small
+// blocks get smaller tables, which are cheaper to build
+int tansTableLog(size_t size, size_t symbolCount);
+// Scale the counts of a block of `size` bytes to 1 << tableLog, keeping
+// every symbol that occurs
+void normalizeCounts(const FrequencyTable& frequencies, size_t size, int tableLog, NormalizedCounts& counts);
+// Coded size of the data in bits, states included, as the counts predict it
+uint64_t tansCodedBits(const FrequencyTable& frequencies, const NormalizedCounts& counts, int tableLog);
+
+// Table log, symbol set (like the Huffman code lengths: count, then a list
+// or bitmap) and one varint per symbol, its normalized count minus one
+void writeNormalizedCounts(std::vector<uint8_t>& out, const NormalizedCounts& counts, int tableLog);
+size_t normalizedCountsSize(const NormalizedCounts& counts);
+// Read and validate what writeNormalizedCounts wrote; advances cur
+NormalizedCounts readNormalizedCounts(const uint8_t*& cur, const uint8_t* end, int& tableLog);
+
+class TansEncodeTable {
+public:
+    void build(const NormalizedCounts& counts, int tableLog);
+    // Append the coded form of data[0, size); every byte must have a count
+    void encode(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size) const;
+
+private:
+    struct SymbolTransform {
+        uint32_t deltaNbBits;    // Bits out are (state + deltaNbBits) >> 16
+        int32_t deltaFindState;  // Offset of the symbol's states in nextStates
+    };
+
+    int tableLog = 0;
+    std::array<SymbolTransform, 256> transforms{};
+    std::vector<uint16_t> nextStates;
+};
+
+class TansDecodeTable {
+public:
+    void build(const NormalizedCounts& counts, int tableLog);
+    // Decode rawSize symbols from data[0, dataSize) into output; throws
+    // when the stream does not end exactly where it should
+    void decode(const uint8_t* data, size_t dataSize, uint32_t rawSize, ORIGINAL_DATA_TYPE* output) const;
+
+private:
+    struct Entry {
+        uint16_t newState; // Next state, before adding the bits read
+        ORIGINAL_DATA_TYPE symbol;
+        uint8_t nbBits;
+    };
+
+    int tableLog = 0;
+    std::vector<Entry> entries;
+};
+
+#endif // TANSCODER_H
@@ -1,11 +1,46 @@
-// include/Utils.h
-#ifndef UTILS_H
-#define UTILS_H
-
-#include <string>
-#include <iostream>
-
-std::string getAbsolutePath(const std::string& filename);
-void printHelp(std::ostream& out);
-
-#endif // UTILS_H
+// include/Utils.h
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+std::string getAbsolutePath(const std::string& filename);
+// "-" stands for standard input or standard output
+bool isStandardStream(const std::string& path);
+void printHelp(std::ostream& out);
+
+// Owning wrapper around a POSIX file descriptor
+class FileDescriptor {
+public:
+    FileDescriptor(const std::string& path, int flags, int mode = 0644);
+    ~FileDescriptor();
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd; }
+    uint64_t size() const;
+    // False for pipes, terminals and devices, which support neither
+    // positional I/O nor resizing
+    bool isRegular() const;
+
+private:
+    int fd;
+};
+
+bool isRegularFile(int fd);
+
+// Positional reads and writes; safe to call concurrently on the same
+// descriptor. Both throw unless the whole range was transferred.
+void readAt(int fd, void* buffer, size_t size, uint64_t offset);
+void writeAt(int fd, const void* buffer, size_t size, uint64_t offset);
+// Read up to `size` bytes at the current position; returns less only at the
+// end of the input, and 0 once it is reached
+size_t readSome(int fd, void* buffer, size_t size);
+// Sequential write at the current position, for descriptors that cannot seek
+void writeAll(int fd, const void* buffer, size_t size);
+
+#endif // UTILS_H
@@ -0,0 +1,107 @@
+// src/Archive.cpp
+#include "Archive.h"
+#include "Checksum.h"
+#include "Format.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> listArchiveFiles(const std::string& directory) {
+    if (!fs::is_directory(directory)) {
+        throw std::runtime_error("Not a directory: " + directory);
+    }
+    std::vector<std::string> names;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            names.push_back(fs::relative(entry.path(), directory).generic_string());
+        }
+    }
+    // Neighbouring names tend to have similar contents, which then share blocks
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+void appendArchiveDirectory(std::vector<uint8_t>& out, const std::vector<ArchiveEntry>& entries,
+                            uint64_t streamSize) {
+    size_t start = out.size();
+    for (const ArchiveEntry& entry : entries) {
+        appendVarint(out, entry.name.size());
+        out.insert(out.end(), entry.name.begin(), entry.name.end());
+        appendVarint(out, entry.size);
+    }
+    uint32_t checksum = crc32c(out.data() + start, out.size() - start);
+    appendUint64(out, entries.size());
+    appendUint64(out, streamSize);
+    appendUint32(out, checksum);
+    out.insert(out.end(), ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof(ARCHIVE_MAGIC));
+}
+
+bool isArchive(int fd, uint64_t fileSize) {
+    uint8_t magic[sizeof(ARCHIVE_MAGIC)];
+    if (fileSize < ARCHIVE_TRAILER_SIZE) {
+        return false;
+    }
+    readAt(fd, magic, sizeof(magic), fileSize - sizeof(ARCHIVE_MAGIC));
+    return std::memcmp(magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0;
+}
+
+std::vector<ArchiveEntry> readArchiveDirectory(int fd, uint64_t fileSize, const std::string& archivePath,
+                                               uint64_t& streamSize) {
+    uint8_t trailer[ARCHIVE_TRAILER_SIZE];
+    if (fileSize < ARCHIVE_TRAILER_SIZE) {
+        throw std::runtime_error("Not an HZip archive: " + archivePath);
+    }
+    readAt(fd, trailer, sizeof(trailer), fileSize - ARCHIVE_TRAILER_SIZE);
+    if (std::memcmp(trailer + 20, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0) {
+        throw std::runtime_error("Not an HZip archive: " + archivePath);
+    }
+
+    // Every directory entry takes at least two bytes
+    uint64_t fileCount = loadUint64(trailer);
+    streamSize = loadUint64(trailer + 8);
+    if (streamSize > fileSize - ARCHIVE_TRAILER_SIZE ||
+        fileCount > (fileSize - ARCHIVE_TRAILER_SIZE - streamSize) / 2) {
+        throw std::runtime_error("Corrupt archive directory");
+    }
+    std::vector<uint8_t> directory(static_cast<size_t>(fileSize - ARCHIVE_TRAILER_SIZE - streamSize));
+    readAt(fd, directory.data(), directory.size(), streamSize);
+    if (crc32c(directory.data(), directory.size()) != loadUint32(trailer + 16)) {
+        throw std::runtime_error("Checksum mismatch: archive directory is corrupt");
+    }
+
+    // Files are stored back to back, so the offsets are running sums of the sizes
+    std::vector<ArchiveEntry> entries(static_cast<size_t>(fileCount));
+    const uint8_t* cur = directory.data();
+    const uint8_t* end = cur + directory.size();
+    uint64_t offset = 0;
+    for (ArchiveEntry& entry : entries) {
+        uint64_t nameSize = readVarint(cur, end);
+        if (nameSize > static_cast<uint64_t>(end - cur)) {
+            throw std::runtime_error("Corrupt archive directory");
+        }
+        entry.name.assign(reinterpret_cast<const char*>(cur), static_cast<size_t>(nameSize));
+        cur += nameSize;
+        entry.size = readVarint(cur, end);
+        entry.offset = offset;
+        offset += entry.size;
+    }
+    if (cur != end) {
+        throw std::runtime_error("Corrupt archive directory");
+    }
+    return entries;
+}
+
+void checkArchiveName(const std::string& name) {
+    fs::path path(name);
+    bool escapes = name.empty() || path.is_absolute() || path.has_root_name();
+    for (const fs::path& part : path) {
+        escapes = escapes || part == "..";
+    }
+    if (escapes) {
+        throw std::runtime_error("Unsafe file name in archive: " + name);
+    }
+}
@@ -0,0 +1,253 @@
+// src/Checksum.cpp
+#include "Checksum.h"
+#include "Format.h"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HZIP_X86_64 1
+#endif
+
+namespace {
+
+// CRC-32C polynomial, bit-reversed
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+// Bytes per lane of the interleaved hardware loop
+constexpr size_t LANE_SIZE = 4096;
+
+using SliceTables = std::array<std::array<uint32_t, 256>, 8>;
+
+// tables[k][b]: checksum register after byte b followed by k zero bytes
+SliceTables buildSliceTables() {
+    SliceTables tables;
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        tables[0][b] = crc;
+    }
+    for (int k = 1; k < 8; ++k) {
+        for (int b = 0; b < 256; ++b) {
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+// Product of two polynomials modulo the CRC polynomial (bit-reversed, so
+// x^0 is the top bit). `a` must not be zero.
+uint32_t multiplyModPoly(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t mask = 1u << 31;; mask >>= 1) {
+        if (a & mask) {
+            product ^= b;
+            if ((a & (mask - 1)) == 0) {
+                break;
+            }
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * size) modulo the CRC polynomial: multiplying a checksum register by
+// it has the effect of running `size` zero bytes through it
+uint32_t zeroBytesOperator(uint64_t size) {
+    // powers[n] = x^(2^n)
+    static const std::array<uint32_t, 67> powers = []() {
+        std::array<uint32_t, 67> table;
+        table[0] = 1u << 30;
+        for (size_t n = 1; n < table.size(); ++n) {
+            table[n] = multiplyModPoly(table[n - 1], table[n - 1]);
+        }
+        return table;
+    }();
+    uint32_t result = 1u << 31;
+    for (size_t n = 3; size != 0; size >>= 1, ++n) {
+        if (size & 1) {
+            result = multiplyModPoly(powers[n], result);
+        }
+    }
+    return result;
+}
+
+uint32_t crcScalar(uint32_t crc, const uint8_t* data, size_t size) {
+    static const SliceTables tables = buildSliceTables();
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word = loadUint64(data) ^ crc;
+        crc = tables[7][word & 0xFF] ^ tables[6][(word >> 8) & 0xFF] ^ tables[5][(word >> 16) & 0xFF] ^
+              tables[4][(word >> 24) & 0xFF] ^ tables[3][(word >> 32) & 0xFF] ^ tables[2][(word >> 40) & 0xFF] ^
+              tables[1][(word >> 48) & 0xFF] ^ tables[0][word >> 56];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef HZIP_X86_64
+// Load the word at src + offset, storing it at dst + offset as well when copying
+template <bool COPY>
+inline uint64_t load64(uint8_t* dst, const uint8_t* src, size_t offset) {
+    uint64_t word;
+    std::memcpy(&word, src + offset, sizeof(word));
+    if (COPY) {
+        std::memcpy(dst + offset, &word, sizeof(word));
+    }
+    return word;
+}
+
+// The crc32 instruction has a latency of three cycles but starts one per
+// cycle, so three independent lanes keep it busy. The lanes are joined by
+// shifting the earlier ones past the later ones' bytes. With COPY the data
+// is also stored to dst.
+template <bool COPY>
+__attribute__((target("sse4.2")))
+uint32_t crcSse42(uint32_t crc, uint8_t* dst, const uint8_t* data, size_t size) {
+    static const uint32_t laneShift = zeroBytesOperator(LANE_SIZE);
+    uint64_t crc0 = crc;
+    for (; size >= 3 * LANE_SIZE; data += 3 * LANE_SIZE, dst += COPY ? 3 * LANE_SIZE : 0, size -= 3 * LANE_SIZE) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < LANE_SIZE; i += 8) {
+            crc0 = _mm_crc32_u64(crc0, load64<COPY>(dst, data, i));
+            crc1 = _mm_crc32_u64(crc1, load64<COPY>(dst, data, LANE_SIZE + i));
+            crc2 = _mm_crc32_u64(crc2, load64<COPY>(dst, data, 2 * LANE_SIZE + i));
+        }
+        crc0 = multiplyModPoly(laneShift, static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = multiplyModPoly(laneShift, static_cast<uint32_t>(crc0)) ^ crc2;
+    }
+    for (; size >= 8; data += 8, dst += COPY ? 8 : 0, size -= 8) {
+        crc0 = _mm_crc32_u64(crc0, load64<COPY>(dst, data, 0));
+    }
+    for (; size > 0; ++data, --size) {
+        if (COPY) {
+            *dst++ = *data;
+        }
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data);
+    }
+    return static_cast<uint32_t>(crc0);
+}
+#endif
+
+// XXH64 primes
+constexpr uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t HASH_PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t HASH_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t HASH_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+    return rotateLeft(acc + input * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+inline uint64_t hashMerge(uint64_t acc, uint64_t lane) {
+    return (acc ^ hashRound(0, lane)) * HASH_PRIME1 + HASH_PRIME4;
+}
+
+bool hasCrcInstruction() {
+#ifdef HZIP_X86_64
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+uint32_t crc32c(const void* data, size_t size, uint32_t crc) {
+    static const bool hardware = hasCrcInstruction();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+#ifdef HZIP_X86_64
+    if (hardware) {
+        return ~crcSse42<false>(~crc, nullptr, bytes, size);
+    }
+#endif
+    return ~crcScalar(~crc, bytes, size);
+}
+
+uint32_t crc32cCopy(void* dst, const void* src, size_t size) {
+    static const bool hardware = hasCrcInstruction();
+#ifdef HZIP_X86_64
+    if (hardware) {
+        return ~crcSse42<true>(~0u, static_cast<uint8_t*>(dst), static_cast<const uint8_t*>(src), size);
+    }
+#endif
+    std::memcpy(dst, src, size);
+    return crc32c(dst, size);
+}
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t sizeB) {
+    // The pre- and post-inversions cancel out
+    return multiplyModPoly(zeroBytesOperator(sizeB), crcA) ^ crcB;
+}
+
+uint32_t crc32cRun(uint8_t value, uint64_t count) {
+    // Join runs of 2^n copies for the bits of count
+    uint32_t crc = 0;
+    uint32_t powerCrc = crc32c(&value, 1);
+    for (uint64_t powerSize = 1; count != 0; count >>= 1, powerSize *= 2) {
+        if (count & 1) {
+            crc = crc32cCombine(crc, powerCrc, powerSize);
+        }
+        if (count > 1) {
+            powerCrc = crc32cCombine(powerCrc, powerCrc, powerSize);
+        }
+    }
+    return crc;
+}
+
+uint64_t hash64(const void* data, size_t size) {
+    const uint8_t* cur = static_cast<const uint8_t*>(data);
+    const uint8_t* end = cur + size;
+    uint64_t hash;
+
+    // Four independent lanes over 32-byte stripes, then merged
+    if (size >= 32) {
+        uint64_t lane0 = HASH_PRIME1 + HASH_PRIME2;
+        uint64_t lane1 = HASH_PRIME2;
+        uint64_t lane2 = 0;
+        uint64_t lane3 = 0 - HASH_PRIME1;
+        for (; end - cur >= 32; cur += 32) {
+            lane0 = hashRound(lane0, loadUint64(cur));
+            lane1 = hashRound(lane1, loadUint64(cur + 8));
+            lane2 = hashRound(lane2, loadUint64(cur + 16));
+            lane3 = hashRound(lane3, loadUint64(cur + 24));
+        }
+        hash = rotateLeft(lane0, 1) + rotateLeft(lane1, 7) + rotateLeft(lane2, 12) + rotateLeft(lane3, 18);
+        hash = hashMerge(hash, lane0);
+        hash = hashMerge(hash, lane1);
+        hash = hashMerge(hash, lane2);
+        hash = hashMerge(hash, lane3);
+    } else {
+        hash = HASH_PRIME5;
+    }
+    hash += size;
+
+    // The last 0 to 31 bytes
+    for (; end - cur >= 8; cur += 8) {
+        hash = rotateLeft(hash ^ hashRound(0, loadUint64(cur)), 27) * HASH_PRIME1 + HASH_PRIME4;
+    }
+    if (end - cur >= 4) {
+        hash = rotateLeft(hash ^ (loadUint32(cur) * HASH_PRIME1), 23) * HASH_PRIME2 + HASH_PRIME3;
+        cur += 4;
+    }
+    for (; cur != end; ++cur) {
+        hash = rotateLeft(hash ^ (*cur * HASH_PRIME5), 11) * HASH_PRIME1;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,154 @@
+// src/Histogram.cpp
+#include "Histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HZIP_X86 1
+#endif
+
+namespace {
+
+// Interleaved count arrays; consecutive bytes go to different arrays
+constexpr int COUNT_ARRAYS = 4;
+using Counts = uint32_t[COUNT_ARRAYS][256];
+
+inline uint64_t load64(const ORIGINAL_DATA_TYPE* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Spread the eight bytes of `word` over the count arrays
+inline void countWord(uint64_t word, Counts counts) {
+    counts[0][word & 0xFF]++;
+    counts[1][(word >> 8) & 0xFF]++;
+    counts[2][(word >> 16) & 0xFF]++;
+    counts[3][(word >> 24) & 0xFF]++;
+    counts[0][(word >> 32) & 0xFF]++;
+    counts[1][(word >> 40) & 0xFF]++;
+    counts[2][(word >> 48) & 0xFF]++;
+    counts[3][word >> 56]++;
+}
+
+void countScalar(const ORIGINAL_DATA_TYPE* data, size_t size, Counts counts) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        countWord(load64(data + i), counts);
+        countWord(load64(data + i + 8), counts);
+    }
+    for (; i < size; ++i) {
+        counts[0][data[i]]++;
+    }
+}
+
+#ifdef HZIP_X86
+// 16 bytes per step. A chunk of one repeated byte (common in skewed data)
+// becomes a single add instead of 16 increments of the same counter.
+void countSse2(const ORIGINAL_DATA_TYPE* data, size_t size, Counts counts) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i first = _mm_set1_epi8(static_cast<char>(data[i]));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, first)) == 0xFFFF) {
+            counts[0][data[i]] += 16;
+            continue;
+        }
+        countWord(load64(data + i), counts);
+        countWord(load64(data + i + 8), counts);
+    }
+    countScalar(data + i, size - i, counts);
+}
+
+// Same as countSse2 with 32 bytes per step
+__attribute__((target("avx2")))
+void countAvx2(const ORIGINAL_DATA_TYPE* data, size_t size, Counts counts) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i first = _mm256_set1_epi8(static_cast<char>(data[i]));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, first)) == -1) {
+            counts[0][data[i]] += 32;
+            continue;
+        }
+        countWord(load64(data + i), counts);
+        countWord(load64(data + i + 8), counts);
+        countWord(load64(data + i + 16), counts);
+        countWord(load64(data + i + 24), counts);
+    }
+    countScalar(data + i, size - i, counts);
+}
+#endif
+
+using CountKernel = void (*)(const ORIGINAL_DATA_TYPE*, size_t, Counts);
+
+CountKernel selectKernel() {
+#ifdef HZIP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return countAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return countSse2;
+    }
+#endif
+    return countScalar;
+}
+
+void countSlice(const ORIGINAL_DATA_TYPE* data, size_t size, FrequencyTable& frequencies) {
+    static const CountKernel kernel = selectKernel();
+    Counts counts = {};
+    kernel(data, size, counts);
+    for (int ch = 0; ch < 256; ++ch) {
+        frequencies[ch] = counts[0][ch] + counts[1][ch] + counts[2][ch] + counts[3][ch];
+    }
+}
+
+} // namespace
+
+void countFrequencies(const ORIGINAL_DATA_TYPE* data, size_t size, FrequencyTable& frequencies, unsigned threads) {
+    if (threads <= 1 || size < PARALLEL_HISTOGRAM_MIN_SIZE) {
+        countSlice(data, size, frequencies);
+        return;
+    }
+
+    // One slice per thread, each at least half the parallel threshold; the
+    // calling thread takes the first one
+    size_t sliceCount = std::min<size_t>(threads, size / (PARALLEL_HISTOGRAM_MIN_SIZE / 2));
+    size_t sliceSize = (size + sliceCount - 1) / sliceCount;
+    std::vector<FrequencyTable> partial(sliceCount);
+    std::vector<std::thread> workers;
+    for (size_t s = 1; s < sliceCount; ++s) {
+        size_t begin = s * sliceSize;
+        size_t length = std::min(sliceSize, size - begin);
+        workers.emplace_back([data, begin, length, &partial, s]() { countSlice(data + begin, length, partial[s]); });
+    }
+    countSlice(data, sliceSize, partial[0]);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    frequencies = partial[0];
+    for (size_t s = 1; s < sliceCount; ++s) {
+        for (int ch = 0; ch < 256; ++ch) {
+            frequencies[ch] += partial[s][ch];
+        }
+    }
+}
+
+uint64_t entropyBytes(const FrequencyTable& frequencies) {
+    uint64_t total = 0;
+    for (uint32_t count : frequencies) {
+        total += count;
+    }
+    double bits = 0.0;
+    for (uint32_t count : frequencies) {
+        if (count > 0) {
+            bits += count * std::log2(static_cast<double>(total) / count);
+        }
+    }
+    return static_cast<uint64_t>(bits / 8.0);
+}
@@ -0,0 +1,83 @@
+// src/HuffmanDecodeTable.cpp
+#include "HuffmanDecodeTable.h"
+#include <algorithm>
+#include <stdexcept>
+
+void HuffmanDecodeTable::build(const CodeLengthTable& codeLengths) {
+    const uint32_t tableSize = 1u << LOOKUP_BITS;
+
+    // Blocks that reuse a code table often follow the block that built it
+    if (built && codeLengths == builtLengths) {
+        return;
+    }
+    built = false;
+
+    // Canonical code ranges: codes of one length are consecutive and the
+    // symbols inside a length are ordered by value
+    lengthCount.fill(0);
+    maxLength = 0;
+    for (uint8_t len : codeLengths) {
+        if (len > MAX_CODE_LENGTH_LIMIT) {
+            throw std::runtime_error("Code length exceeds the supported maximum");
+        }
+        if (len > 0) {
+            lengthCount[len]++;
+            maxLength = std::max<int>(maxLength, len);
+        }
+    }
+    if (maxLength == 0) {
+        throw std::runtime_error("Code table is empty");
+    }
+
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH_LIMIT; ++len) {
+        code = (code + lengthCount[len - 1]) << 1;
+        firstCode[len] = code;
+        firstIndex[len] = index;
+        index += lengthCount[len];
+        if (lengthCount[len] > 0 && ((code + lengthCount[len] - 1) >> len) != 0) {
+            throw std::runtime_error("Invalid code lengths: over-subscribed code");
+        }
+    }
+
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 1> nextIndex = firstIndex;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (codeLengths[ch] > 0) {
+            sortedSymbols[nextIndex[codeLengths[ch]]++] = static_cast<ORIGINAL_DATA_TYPE>(ch);
+        }
+    }
+
+    // First level: one symbol per entry for every code that fits in LOOKUP_BITS
+    std::vector<Entry> single(tableSize, Entry{{0}, 0, 0});
+    for (int len = 1; len <= std::min(maxLength, LOOKUP_BITS); ++len) {
+        int freeBits = LOOKUP_BITS - len;
+        for (uint32_t i = 0; i < lengthCount[len]; ++i) {
+            uint32_t value = firstCode[len] + i;
+            uint32_t first = value << freeBits;
+            uint32_t last = (value + 1) << freeBits;
+            for (uint32_t j = first; j < last; ++j) {
+                single[j].symbols[0] = sortedSymbols[firstIndex[len] + i];
+                single[j].symbolCount = 1;
+                single[j].bitLength = static_cast<uint8_t>(len);
+            }
+        }
+    }
+
+    // Second pass: chain further symbols while their codes still fit in the
+    // remaining (real) bits of the index
+    entries.assign(tableSize, Entry{{0}, 0, 0});
+    for (uint32_t i = 0; i < tableSize; ++i) {
+        Entry& entry = entries[i];
+        while (entry.symbolCount < MAX_SYMBOLS_PER_ENTRY) {
+            const Entry& next = single[(i << entry.bitLength) & (tableSize - 1)];
+            if (next.symbolCount == 0 || entry.bitLength + next.bitLength > LOOKUP_BITS) {
+                break;
+            }
+            entry.symbols[entry.symbolCount++] = next.symbols[0];
+            entry.bitLength += next.bitLength;
+        }
+    }
+    builtLengths = codeLengths;
+    built = true;
+}
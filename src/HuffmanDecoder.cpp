@@ -1,165 +1,1218 @@
-// src/HuffmanDecoder.cpp
-#include "HuffmanDecoder.h"
-#include "HuffmanTree.h"
-#include "BitIO.h"
-#include <fstream>
-#include <stdexcept>
-#include <iostream>
-#include <filesystem>
-
-// Utility function declaration (assumed to be in Utils.h)
-std::string getAbsolutePath(const std::string& filename);
-
-void HuffmanDecoder::decompress(const std::string& inputPath, const std::string& outputPath) {
-    // Open input file
-    std::ifstream inputFile(inputPath, std::ios::binary);
-    if (!inputFile.is_open()) {
-        throw std::runtime_error("Unable to open input file: " + inputPath);
-    }
-
-    // Get file size
-    inputFile.seekg(0, std::ios::end);
-    std::streampos fileSize = inputFile.tellg();
-
-    // Return to the beginning of the file
-    inputFile.seekg(0, std::ios::beg);
-
-    // Read the size of the code table (1 byte)
-    uint8_t tableSize = 0;
-    if (!inputFile.read(reinterpret_cast<char*>(&tableSize), sizeof(uint8_t))) {
-        throw std::runtime_error("Unable to read code table size");
-    }
-
-    // Read the total number of characters (4 bytes)
-    int totalChars = 0;
-    if (!inputFile.read(reinterpret_cast<char*>(&totalChars), sizeof(int))) {
-        throw std::runtime_error("Unable to read total number of characters");
-    }
-
-    // Read the code table
-    std::unordered_map<std::vector<bool>, ORIGINAL_DATA_TYPE, VectorBoolHash> inverseCodeTable;
-    for (int i = 0; i < tableSize; ++i) {
-        // Read character (1 byte)
-        ORIGINAL_DATA_TYPE charKey;
-        if (!inputFile.read(reinterpret_cast<char*>(&charKey), sizeof(ORIGINAL_DATA_TYPE))) {
-            throw std::runtime_error("Unable to read character from code table");
-        }
-
-        // Read code length (1 byte)
-        uint8_t codeLength = 0;
-        if (!inputFile.read(reinterpret_cast<char*>(&codeLength), sizeof(uint8_t))) {
-            throw std::runtime_error("Unable to read code length");
-        }
-
-        // Calculate the number of bytes needed to read
-        int bytesNeeded = (codeLength + 7) / 8;
-
-        // Read encoded bits
-        std::vector<uint8_t> packedBytes(bytesNeeded);
-        if (!inputFile.read(reinterpret_cast<char*>(packedBytes.data()), bytesNeeded)) {
-            throw std::runtime_error("Unable to read encoded bits");
-        }
-
-        // Unpack bits
-        std::vector<bool> codeBits;
-        for (size_t b = 0; b < packedBytes.size(); ++b) {
-            uint8_t byte = packedBytes[b];
-            for (int bit = 7; bit >= 0; --bit) {
-                if (codeBits.size() < codeLength) {
-                    bool bitValue = (byte >> bit) & 1;
-                    codeBits.push_back(bitValue);
-                }
-            }
-        }
-
-        inverseCodeTable[codeBits] = charKey;
-    }
-
-    // Calculate the position of the padding bits
-    // Padding bits are in the last byte of the file
-    if (fileSize < 1) {
-        throw std::runtime_error("File too small to contain padding bits");
-    }
-    inputFile.seekg(-static_cast<std::streamoff>(1), std::ios::end);
-    uint8_t padding = 0;
-    if (!inputFile.read(reinterpret_cast<char*>(&padding), sizeof(uint8_t))) {
-        throw std::runtime_error("Unable to read number of padding bits");
-    }
-
-    // Calculate the start position and length of the data section
-    // Note: Ensure correct calculation of data start position and size
-    // Skip header information (tableSize and totalChars)
-    inputFile.seekg(1 + sizeof(int), std::ios::beg); // Skip tableSize and totalChars
-
-    // Skip code table
-    for (int i = 0; i < tableSize; ++i) {
-        // Skip character (1 byte) and code length (1 byte)
-        inputFile.seekg(1 + 1, std::ios::cur);
-        // Read code length
-        uint8_t codeLength = 0;
-        inputFile.seekg(-1, std::ios::cur); // Move back to read codeLength
-        if (!inputFile.read(reinterpret_cast<char*>(&codeLength), sizeof(uint8_t))) {
-            throw std::runtime_error("Unable to read code length");
-        }
-        // Calculate the number of bytes to skip
-        int bytesToSkip = (codeLength + 7) / 8;
-        inputFile.seekg(bytesToSkip, std::ios::cur);
-    }
-
-    // Data start position
-    std::streampos dataBegin = inputFile.tellg();
-
-    // Data size: total file size - data start position - 1 (padding byte)
-    // Convert std::streampos to std::streamoff for subtraction
-    std::streamoff dataSizeOffset = fileSize - static_cast<std::streamoff>(dataBegin) - static_cast<std::streamoff>(1);
-    size_t dataSize = static_cast<size_t>(dataSizeOffset);
-
-    // Reposition to the start of the data section
-    inputFile.seekg(dataBegin, std::ios::beg);
-
-    // Build Huffman tree
-    HuffmanTree tree;
-    tree.buildTreeFromCodeTable(inverseCodeTable);
-
-    // Open output file
-    std::ofstream outputFile(outputPath, std::ios::binary);
-    if (!outputFile.is_open()) {
-        throw std::runtime_error("Unable to open output file: " + outputPath);
-    }
-
-    // Initialize BitReader with data size
-    BitReader bitReader(inputFile, dataSize);
-
-    // Decode data
-    std::shared_ptr<HuffmanNode> currentNode = tree.root;
-    int decodedChars = 0;
-    bool bitValue;
-
-    while (decodedChars < totalChars && bitReader.readBit(bitValue)) {
-        if (bitValue) {
-            if (currentNode->right) {
-                currentNode = currentNode->right;
-            } else {
-                throw std::runtime_error("Decoding error: invalid bit sequence");
-            }
-        } else {
-            if (currentNode->left) {
-                currentNode = currentNode->left;
-            } else {
-                throw std::runtime_error("Decoding error: invalid bit sequence");
-            }
-        }
-
-        if (currentNode->isLeaf()) {
-            outputFile.write(reinterpret_cast<const char*>(&currentNode->character), sizeof(ORIGINAL_DATA_TYPE));
-            decodedChars++;
-            currentNode = tree.root;
-        }
-    }
-
-    // Close files
-    inputFile.close();
-    outputFile.close();
-
-    std::cout << "Decompression complete!" << std::endl;
-}
+// src/HuffmanDecoder.cpp
+#include "HuffmanDecoder.h"
+#include "HuffmanTree.h"
+#include "Format.h"
+#include "HuffmanDecodeTable.h"
+#include "BitIO.h"
+#include "ThreadPool.h"
+#include "BlockPipeline.h"
+#include "Utils.h"
+#include "MappedFile.h"
+#include "Checksum.h"
+#include "Archive.h"
+#include "TansCoder.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <iostream>
+#include <filesystem>
+#include <deque>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// What reference blocks are copied from, kept by the stages that finish
+// blocks in order: the sizes and checksums of the last `window` blocks and,
+// for outputs that cannot be read back, their bytes as well
+class DedupHistory {
+public:
+    DedupHistory(uint64_t window, bool keepBytes) : window(window), keepBytes(keepBytes && window > 0) {}
+
+    // Blocks recorded so far, which is the number of the next block
+    uint64_t count() const { return blocks; }
+
+    // Number of the block that reference block `number` repeats, after
+    // checking that it is still kept and its size and checksum match
+    uint64_t source(uint64_t number, uint64_t distance, uint32_t rawSize, uint32_t checksum) const {
+        if (distance == 0 || distance > number || distance > recent.size()) {
+            throw std::runtime_error("Corrupt block: reference out of range");
+        }
+        const KeptBlock& kept = recent[recent.size() - static_cast<size_t>(distance)];
+        if (kept.rawSize != rawSize || kept.checksum != checksum) {
+            throw std::runtime_error("Checksum mismatch: block is corrupt");
+        }
+        return number - distance;
+    }
+
+    // Kept bytes of a block at most `window` blocks back
+    const std::vector<ORIGINAL_DATA_TYPE>& bytes(uint64_t number) const {
+        return recent[recent.size() - static_cast<size_t>(count() - number)].bytes;
+    }
+
+    // Record the next block. Its bytes are taken over when they are kept;
+    // `bytes` then gets the buffer of the block leaving the window, if any.
+    void add(uint32_t rawSize, uint32_t checksum, std::vector<ORIGINAL_DATA_TYPE>& bytes) {
+        blocks++;
+        if (window == 0) {
+            return;
+        }
+        recent.push_back(KeptBlock{rawSize, checksum, {}});
+        if (keepBytes) {
+            recent.back().bytes.swap(bytes);
+            bytes.clear();
+        }
+        if (recent.size() > window) {
+            if (keepBytes) {
+                bytes.swap(recent.front().bytes);
+            }
+            recent.pop_front();
+        }
+    }
+
+private:
+    struct KeptBlock {
+        uint32_t rawSize;
+        uint32_t checksum;
+        std::vector<ORIGINAL_DATA_TYPE> bytes;
+    };
+
+    uint64_t window;
+    bool keepBytes;
+    uint64_t blocks = 0;
+    std::deque<KeptBlock> recent;
+};
+
+} // namespace
+
+HuffmanDecoder::HuffmanDecoder(const DecoderOptions& options) : options(options) {}
+
+void HuffmanDecoder::decompress(const std::string& inputPath, const std::string& outputPath) {
+    RunStats stats;
+    stats.operation = "decompress";
+    StatsClock::time_point startTime = StatsClock::now();
+
+    // Status goes to standard error when the data goes to standard output
+    std::ostream& status = isStandardStream(outputPath) ? std::cerr : std::cout;
+
+    decodeFile(inputPath, outputPath, stats);
+    stats.wall = lapSeconds(startTime);
+
+    printStats(std::cerr, stats, options.stats);
+    status << "Decompression complete!" << std::endl;
+}
+
+void HuffmanDecoder::test(const std::string& inputPath) {
+    RunStats stats;
+    stats.operation = "test";
+    StatsClock::time_point startTime = StatsClock::now();
+
+    decodeFile(inputPath, "", stats);
+    stats.wall = lapSeconds(startTime);
+
+    printStats(std::cerr, stats, options.stats);
+    std::cout << "Test passed: " << stats.blocks << " blocks, " << stats.bytesOut << " bytes, checksums match"
+              << std::endl;
+}
+
+void HuffmanDecoder::decodeFile(const std::string& inputPath, const std::string& outputPath, RunStats& stats) {
+    // Open input file ("-" reads standard input)
+    std::unique_ptr<FileDescriptor> inputFile;
+    if (!isStandardStream(inputPath)) {
+        inputFile = std::make_unique<FileDescriptor>(inputPath, O_RDONLY);
+    }
+
+    // The compressed stream of an archive ends where its directory starts.
+    // Only a test takes archives here, checking the directory as well;
+    // anything else is refused before the output is created.
+    bool indexed = inputFile && inputFile->isRegular();
+    uint64_t fileSize = indexed ? inputFile->size() : 0;
+    uint64_t streamSize = fileSize;
+    std::vector<ArchiveEntry> entries;
+    bool archive = indexed && isArchive(inputFile->get(), fileSize);
+    if (archive) {
+        if (!outputPath.empty()) {
+            throw std::runtime_error(inputPath + " is an archive; extract it with -d -r");
+        }
+        entries = readArchiveDirectory(inputFile->get(), fileSize, inputPath, streamSize);
+    }
+
+    // Open output file ("-" writes to standard output); a test has none
+    std::unique_ptr<FileDescriptor> outputFile;
+    int outputFd = -1;
+    if (isStandardStream(outputPath)) {
+        outputFd = STDOUT_FILENO;
+    } else if (!outputPath.empty()) {
+        outputFile = std::make_unique<FileDescriptor>(outputPath, O_RDWR | O_CREAT | O_TRUNC);
+        outputFd = outputFile->get();
+    }
+
+    if (indexed) {
+        decompressIndexed(*inputFile, streamSize, inputPath, outputFd, outputPath, stats);
+        if (archive) {
+            uint64_t filesSize = entries.empty() ? 0 : entries.back().offset + entries.back().size;
+            if (filesSize != stats.bytesOut) {
+                throw std::runtime_error("Corrupt archive directory: file sizes do not match the data");
+            }
+            stats.bytesIn = fileSize;
+        }
+    } else {
+        // Inputs that cannot seek are decoded front to back without the index
+        std::ifstream inputFileStream;
+        std::istream* inputStream = &std::cin;
+        if (inputFile) {
+            inputFileStream.open(inputPath, std::ios::binary);
+            if (!inputFileStream.is_open()) {
+                throw std::runtime_error("Unable to open input file: " + inputPath);
+            }
+            inputStream = &inputFileStream;
+        }
+        decompressStream(*inputStream, inputPath, outputFd, stats);
+    }
+}
+
+void HuffmanDecoder::decompressIndexed(const FileDescriptor& inputFile, uint64_t fileSize,
+                                       const std::string& inputPath, int outputFd, const std::string& outputPath,
+                                       RunStats& stats) {
+    // Map the input when possible so blocks are decoded straight from the
+    // page cache
+    std::unique_ptr<MappedFile> inputMap = MappedFile::tryMap(inputFile.get(), fileSize, false);
+    if (inputMap) {
+        inputMap->adviseSequential();
+    }
+
+    // Locate every block through the index at the end of the file
+    IndexLocation location;
+    std::vector<BlockIndexEntry> blockIndex = readBlockIndex(inputFile.get(), fileSize, inputPath, location);
+    const HuffmanDecodeTable* sharedTable = sharedDecodeTable(location.tableId);
+    uint64_t totalSize = blockIndex.empty() ? 0 : blockIndex.back().rawOffset + blockIndex.back().rawSize;
+
+    // A regular output file gets its final size up front, so blocks can be
+    // placed at their offsets in any order: decoded directly into a mapping
+    // of the output, or written with one pwrite each. Other outputs (pipes,
+    // devices) receive the blocks in order. Without an output the blocks
+    // are only checked.
+    bool positional = outputFd >= 0 && isRegularFile(outputFd);
+    std::unique_ptr<MappedFile> outputMap;
+    if (positional) {
+        if (::ftruncate(outputFd, static_cast<off_t>(totalSize)) != 0) {
+            throw std::runtime_error("Unable to resize output file: " + outputPath);
+        }
+        // Stores into a mapping of a sparse file fail with SIGBUS when the
+        // disk fills up, so the space is reserved first. File systems that
+        // cannot reserve it get pwrite, which reports a full disk instead.
+        int reserved = totalSize > 0 ? ::posix_fallocate(outputFd, 0, static_cast<off_t>(totalSize)) : 0;
+        if (reserved == 0) {
+            outputMap = MappedFile::tryMap(outputFd, totalSize, true);
+        } else if (reserved != EOPNOTSUPP) {
+            throw std::runtime_error("Unable to reserve space for output file: " + outputPath + " (" +
+                                     std::strerror(reserved) + ")");
+        }
+    }
+
+    // Decode the blocks in parallel. Reference blocks are filled in by
+    // finishNextBlock, in order, after the block they repeat: copied within
+    // the output mapping or file, or from the recent blocks kept for outputs
+    // that cannot be read back.
+    ThreadPool pool(options.threads);
+    const size_t maxInFlight = pool.size() * 2;
+    std::deque<std::future<DecodedBlock>> pending;
+    const uint8_t* input = inputMap ? inputMap->data() : nullptr;
+    const MappedFile* output = outputMap.get();
+    const uint64_t dedupWindow = location.dedupWindow;
+    DedupHistory history(dedupWindow, !positional && outputFd >= 0);
+    StatsClock::time_point phaseStart;
+    uint32_t checksum = 0;
+    auto finishNextBlock = [&]() {
+        phaseStart = StatsClock::now();
+        DecodedBlock block = pending.front().get();
+        pending.pop_front();
+        stats.wait += lapSeconds(phaseStart);
+        const BlockIndexEntry& entry = blockIndex[history.count()];
+        if (block.reference != 0) {
+            uint64_t source = history.source(history.count(), block.reference, entry.rawSize, block.checksum);
+            uint64_t sourceOffset = blockIndex[source].rawOffset;
+            if (output) {
+                std::memcpy(output->data() + entry.rawOffset, output->data() + sourceOffset, entry.rawSize);
+            } else if (positional) {
+                block.bytes.resize(entry.rawSize);
+                readAt(outputFd, block.bytes.data(), entry.rawSize, sourceOffset);
+                writeAt(outputFd, block.bytes.data(), entry.rawSize, entry.rawOffset);
+            } else if (outputFd >= 0) {
+                block.bytes = history.bytes(source);
+            }
+            stats.dedupBlocks++;
+            stats.write += lapSeconds(phaseStart);
+        }
+        if (!positional && outputFd >= 0) {
+            writeAll(outputFd, block.bytes.data(), block.bytes.size());
+            stats.write += lapSeconds(phaseStart);
+        }
+        stats.decoder += block.times;
+        checksum = crc32cCombine(checksum, block.checksum, entry.rawSize);
+        history.add(entry.rawSize, block.checksum, block.bytes);
+    };
+    for (size_t number = 0; number < blockIndex.size(); ++number) {
+        const BlockIndexEntry entry = blockIndex[number];
+        pending.push_back(pool.submit([&inputFile, &blockIndex, outputFd, input, output, positional, number, entry,
+                                       dedupWindow, sharedTable]() {
+            HuffmanDecodeTable decodeTable;
+            DecodedBlock block;
+            if (output) {
+                decodeIndexedBlock(inputFile.get(), input, blockIndex, number, dedupWindow, decodeTable, sharedTable,
+                                   output->data() + entry.rawOffset, block);
+            } else {
+                block.bytes.resize(entry.rawSize);
+                decodeIndexedBlock(inputFile.get(), input, blockIndex, number, dedupWindow, decodeTable, sharedTable,
+                                   block.bytes.data(), block);
+                if (positional) {
+                    if (block.reference == 0) {
+                        writeAt(outputFd, block.bytes.data(), entry.rawSize, entry.rawOffset);
+                    }
+                    block.bytes.clear();
+                } else if (outputFd < 0) {
+                    block.bytes = std::vector<ORIGINAL_DATA_TYPE>();
+                }
+            }
+            return block;
+        }));
+        if (pending.size() >= maxInFlight) {
+            finishNextBlock();
+        }
+    }
+    while (!pending.empty()) {
+        finishNextBlock();
+    }
+    if (checksum != location.checksum) {
+        throw std::runtime_error("Checksum mismatch: the data does not match the checksum in the trailer");
+    }
+
+    stats.bytesIn = fileSize;
+    stats.bytesOut = totalSize;
+    stats.blocks = blockIndex.size();
+    stats.threads = pool.size();
+}
+
+void HuffmanDecoder::decompressStream(std::istream& inputStream, const std::string& inputPath, int outputFd,
+                                      RunStats& stats) {
+    uint8_t fileHeader[FILE_HEADER_SIZE];
+    if (!inputStream.read(reinterpret_cast<char*>(fileHeader), sizeof(fileHeader))) {
+        throw std::runtime_error("Not an HZip compressed file: " + inputPath);
+    }
+    IndexLocation location;
+    parseFileHeader(fileHeader, inputPath, location);
+    const uint32_t blockSize = location.blockSize;
+    const uint64_t dedupWindow = location.dedupWindow;
+    const HuffmanDecodeTable* sharedTable = sharedDecodeTable(location.tableId);
+
+    // Blocks go through a reader, decoder and writer pipeline, so reading
+    // and writing overlap the decoding; only a bounded number of them is
+    // held in memory
+    unsigned coders = ThreadPool::resolveThreadCount(options.threads);
+    uint64_t blockCount = 0;
+    stats.bytesIn = FILE_HEADER_SIZE;
+
+    // The reader keeps the code lengths of the recent blocks that have their
+    // own, and hands them to the blocks that reuse them
+    std::deque<std::pair<uint64_t, CodeLengthTable>> recentTables;
+    CodeLengthTable codeLengths;
+    auto readBlock = [&](StreamBlock& job) {
+        StatsClock::time_point readStart = StatsClock::now();
+        uint8_t blockHeader[BLOCK_HEADER_SIZE];
+        if (!inputStream.read(reinterpret_cast<char*>(blockHeader), 4)) {
+            throw std::runtime_error("Unexpected end of file: missing end marker");
+        }
+        job.rawSize = loadUint32(blockHeader);
+        if (job.rawSize == 0) {
+            return false;
+        }
+        if (!inputStream.read(reinterpret_cast<char*>(blockHeader + 4), BLOCK_HEADER_SIZE - 4)) {
+            throw std::runtime_error("Unable to read block header");
+        }
+        uint32_t payloadSize = loadUint32(blockHeader + 4);
+        job.checksum = loadUint32(blockHeader + 8);
+        if (job.rawSize > blockSize || payloadSize > maxPayloadSize(job.rawSize)) {
+            throw std::runtime_error("Corrupt block header");
+        }
+        job.payload.resize(payloadSize);
+        if (!inputStream.read(reinterpret_cast<char*>(job.payload.data()), payloadSize)) {
+            throw std::runtime_error("Unable to read block data");
+        }
+        while (!recentTables.empty() && blockCount - recentTables.front().first > RECENT_TABLE_WINDOW) {
+            recentTables.pop_front();
+        }
+        uint64_t distance = recentTableDistance(job.payload.data(), payloadSize);
+        job.reusesTable = distance != 0;
+        if (job.reusesTable) {
+            auto found = std::find_if(recentTables.begin(), recentTables.end(),
+                                      [&](const std::pair<uint64_t, CodeLengthTable>& table) {
+                                          return table.first == blockCount - distance;
+                                      });
+            if (found == recentTables.end()) {
+                throw std::runtime_error("Corrupt block: reused code table not found");
+            }
+            job.recentTable = found->second;
+        } else if (ownCodeLengths(job.payload.data(), payloadSize, codeLengths)) {
+            recentTables.emplace_back(blockCount, codeLengths);
+        }
+        stats.read += lapSeconds(readStart);
+        stats.bytesIn += BLOCK_HEADER_SIZE + payloadSize;
+        blockCount++;
+        return true;
+    };
+    auto decodeStreamBlock = [sharedTable, dedupWindow](StreamBlock& job) {
+        job.decoded.times = DecoderPhaseTimes();
+        job.decoded.reference = referenceDistance(job.payload.data(), job.payload.size(), dedupWindow);
+        if (job.decoded.reference == 0) {
+            job.decoded.bytes.resize(job.rawSize);
+            decodeBlock(job.payload.data(), job.payload.size(), job.rawSize, job.checksum, job.decodeTable,
+                        sharedTable, job.reusesTable ? &job.recentTable : nullptr, job.decoded.bytes.data(),
+                        job.decoded.times);
+        }
+    };
+    // The writer keeps the last blocks for the reference blocks to copy
+    uint32_t checksum = 0;
+    DedupHistory history(dedupWindow, outputFd >= 0);
+    auto writeBlock = [&](StreamBlock& job) {
+        StatsClock::time_point writeStart = StatsClock::now();
+        if (job.decoded.reference != 0) {
+            uint64_t source = history.source(history.count(), job.decoded.reference, job.rawSize, job.checksum);
+            if (outputFd >= 0) {
+                job.decoded.bytes = history.bytes(source);
+            }
+            stats.dedupBlocks++;
+        }
+        if (outputFd >= 0) {
+            writeAll(outputFd, job.decoded.bytes.data(), job.decoded.bytes.size());
+        }
+        stats.write += lapSeconds(writeStart);
+        stats.decoder += job.decoded.times;
+        stats.bytesOut += job.rawSize;
+        checksum = crc32cCombine(checksum, job.checksum, job.rawSize);
+        history.add(job.rawSize, job.checksum, job.decoded.bytes);
+    };
+    stats.stalls = runBlockPipeline<StreamBlock>(coders, readBlock, decodeStreamBlock, writeBlock);
+    stats.wait = stats.stalls.writerWait;
+
+    // The block index is not needed here; just check that the trailer
+    // agrees with what was read. The index and trailer run to the end of
+    // the input; only the last TRAILER_SIZE bytes are kept while reading.
+    uint8_t trailer[TRAILER_SIZE];
+    size_t kept = 0;
+    uint64_t footerSize = 0;
+    std::vector<char> chunk(64 * 1024);
+    while (inputStream.read(chunk.data(), chunk.size()) || inputStream.gcount() > 0) {
+        size_t got = static_cast<size_t>(inputStream.gcount());
+        footerSize += got;
+        if (got >= TRAILER_SIZE) {
+            std::memcpy(trailer, chunk.data() + got - TRAILER_SIZE, TRAILER_SIZE);
+            kept = TRAILER_SIZE;
+        } else {
+            size_t keep = std::min(kept, TRAILER_SIZE - got);
+            std::memmove(trailer, trailer + kept - keep, keep);
+            std::memcpy(trailer + keep, chunk.data(), got);
+            kept = keep + got;
+        }
+    }
+    if (kept < TRAILER_SIZE) {
+        throw std::runtime_error("Missing block index (truncated file?)");
+    }
+    if (std::memcmp(trailer + 20, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0) {
+        throw std::runtime_error(inputPath + " is an archive; extract it with -d -r");
+    }
+    if (std::memcmp(trailer + 20, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || loadUint64(trailer) != blockCount ||
+        loadUint64(trailer + 8) != stats.bytesIn + 4) {
+        throw std::runtime_error("Corrupt block index");
+    }
+    if (loadUint32(trailer + 16) != checksum) {
+        throw std::runtime_error("Checksum mismatch: the data does not match the checksum in the trailer");
+    }
+
+    stats.bytesIn += 4 + footerSize;
+    stats.blocks = blockCount;
+    stats.threads = coders;
+}
+
+void HuffmanDecoder::extract(const std::string& inputPath, const std::string& outputPath,
+                             uint64_t offset, uint64_t length) {
+    std::vector<ORIGINAL_DATA_TYPE> data = readRange(inputPath, offset, length);
+
+    // "-" writes to standard output; status then goes to standard error
+    std::ostream& status = isStandardStream(outputPath) ? std::cerr : std::cout;
+    std::ofstream outputFileStream;
+    std::ostream* outputStream = &std::cout;
+    if (!isStandardStream(outputPath)) {
+        outputFileStream.open(outputPath, std::ios::binary);
+        if (!outputFileStream.is_open()) {
+            throw std::runtime_error("Unable to open output file: " + outputPath);
+        }
+        outputStream = &outputFileStream;
+    }
+    if (!outputStream->write(reinterpret_cast<const char*>(data.data()), data.size()) || !outputStream->flush()) {
+        throw std::runtime_error("Unable to write output file: " + outputPath);
+    }
+
+    status << "Extraction complete!" << std::endl;
+}
+
+std::vector<ORIGINAL_DATA_TYPE> HuffmanDecoder::readRange(const std::string& inputPath, uint64_t offset, uint64_t length) {
+    if (isStandardStream(inputPath)) {
+        throw std::invalid_argument("Range extraction needs a seekable input file");
+    }
+    FileDescriptor inputFile(inputPath, O_RDONLY);
+    uint64_t fileSize = inputFile.size();
+    std::unique_ptr<MappedFile> inputMap = MappedFile::tryMap(inputFile.get(), fileSize, false);
+    IndexLocation location;
+    std::vector<BlockIndexEntry> blockIndex = readBlockIndex(inputFile.get(), fileSize, inputPath, location);
+    const HuffmanDecodeTable* sharedTable = sharedDecodeTable(location.tableId);
+    uint64_t totalSize = blockIndex.empty() ? 0 : blockIndex.back().rawOffset + blockIndex.back().rawSize;
+
+    if (offset > totalSize) {
+        throw std::out_of_range("Range starts beyond the end of the data (" + std::to_string(totalSize) + " bytes)");
+    }
+    length = std::min(length, totalSize - offset);
+    std::vector<ORIGINAL_DATA_TYPE> result(static_cast<size_t>(length));
+    const uint8_t* input = inputMap ? inputMap->data() : nullptr;
+    if (length == 0) {
+        return result;
+    }
+
+    // Blocks covering [offset, offset + length): the first one is the last
+    // block starting at or before offset
+    uint64_t rangeEnd = offset + length;
+    auto first = std::upper_bound(blockIndex.begin(), blockIndex.end(), offset,
+                                  [](uint64_t value, const BlockIndexEntry& entry) { return value < entry.rawOffset; }) - 1;
+    auto last = std::lower_bound(blockIndex.begin(), blockIndex.end(), rangeEnd,
+                                 [](const BlockIndexEntry& entry, uint64_t value) { return entry.rawOffset < value; });
+
+    // Decode only those blocks, in parallel, and copy the overlapping bytes
+    unsigned blockCount = static_cast<unsigned>(last - first);
+    ThreadPool pool(std::min(ThreadPool::resolveThreadCount(options.threads), blockCount));
+    std::vector<std::future<void>> pending;
+    for (auto it = first; it != last; ++it) {
+        const BlockIndexEntry entry = *it;
+        size_t number = static_cast<size_t>(it - blockIndex.begin());
+        pending.push_back(pool.submit([&inputFile, input, &blockIndex, &location, &result, entry, number, offset,
+                                       rangeEnd, sharedTable]() {
+            HuffmanDecodeTable decodeTable;
+            DecoderPhaseTimes times;
+            std::vector<ORIGINAL_DATA_TYPE> output(entry.rawSize);
+            decodeIndexedBlockAt(inputFile.get(), input, blockIndex, number, location.dedupWindow, decodeTable,
+                                 sharedTable, output.data(), times);
+
+            uint64_t copyBegin = std::max(offset, entry.rawOffset);
+            uint64_t copyEnd = std::min(rangeEnd, entry.rawOffset + entry.rawSize);
+            std::memcpy(result.data() + (copyBegin - offset), output.data() + (copyBegin - entry.rawOffset),
+                        static_cast<size_t>(copyEnd - copyBegin));
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+    return result;
+}
+
+void HuffmanDecoder::extractArchive(const std::string& archivePath, const std::string& outputDir,
+                                    const std::vector<std::string>& names) {
+    RunStats stats;
+    stats.operation = "extract";
+    StatsClock::time_point startTime = StatsClock::now();
+    if (isStandardStream(archivePath)) {
+        throw std::invalid_argument("Archive extraction needs a seekable input file");
+    }
+    FileDescriptor archiveFile(archivePath, O_RDONLY);
+    uint64_t fileSize = archiveFile.size();
+    uint64_t streamSize = 0;
+    std::vector<ArchiveEntry> entries = readArchiveDirectory(archiveFile.get(), fileSize, archivePath, streamSize);
+
+    // The compressed stream ends where the directory starts
+    std::unique_ptr<MappedFile> inputMap = MappedFile::tryMap(archiveFile.get(), streamSize, false);
+    IndexLocation location;
+    std::vector<BlockIndexEntry> blockIndex = readBlockIndex(archiveFile.get(), streamSize, archivePath, location);
+    const HuffmanDecodeTable* sharedTable = sharedDecodeTable(location.tableId);
+    uint64_t totalSize = blockIndex.empty() ? 0 : blockIndex.back().rawOffset + blockIndex.back().rawSize;
+    uint64_t filesSize = entries.empty() ? 0 : entries.back().offset + entries.back().size;
+    if (filesSize != totalSize) {
+        throw std::runtime_error("Corrupt archive directory: file sizes do not match the data");
+    }
+
+    // The files to extract, in stream order
+    std::vector<ArchiveEntry> selected;
+    if (names.empty()) {
+        selected = entries;
+    }
+    for (const std::string& name : names) {
+        auto found = std::find_if(entries.begin(), entries.end(),
+                                  [&name](const ArchiveEntry& entry) { return entry.name == name; });
+        if (found == entries.end()) {
+            throw std::runtime_error("No file named " + name + " in the archive");
+        }
+        selected.push_back(*found);
+    }
+    std::sort(selected.begin(), selected.end(),
+              [](const ArchiveEntry& a, const ArchiveEntry& b) { return a.offset < b.offset; });
+    for (const ArchiveEntry& entry : selected) {
+        checkArchiveName(entry.name);
+    }
+
+    // Every file is created at its final size up front, so the blocks can
+    // fill in their parts in any order
+    std::filesystem::create_directories(outputDir);
+    for (const ArchiveEntry& entry : selected) {
+        std::filesystem::path path = std::filesystem::path(outputDir) / entry.name;
+        std::filesystem::create_directories(path.parent_path());
+        FileDescriptor file(path.string(), O_WRONLY | O_CREAT | O_TRUNC);
+        if (::ftruncate(file.get(), static_cast<off_t>(entry.size)) != 0) {
+            throw std::runtime_error("Unable to resize output file: " + path.string());
+        }
+    }
+
+    // Blocks holding any byte of those files
+    std::vector<size_t> blocks;
+    for (const ArchiveEntry& entry : selected) {
+        if (entry.size == 0) {
+            continue;
+        }
+        auto first = std::upper_bound(blockIndex.begin(), blockIndex.end(), entry.offset,
+                                      [](uint64_t value, const BlockIndexEntry& block) {
+                                          return value < block.rawOffset;
+                                      });
+        auto last = std::lower_bound(blockIndex.begin(), blockIndex.end(), entry.offset + entry.size,
+                                     [](const BlockIndexEntry& block, uint64_t value) {
+                                         return block.rawOffset < value;
+                                     });
+        for (auto it = first - 1; it < last; ++it) {
+            if (blocks.empty() || blocks.back() < static_cast<size_t>(it - blockIndex.begin())) {
+                blocks.push_back(static_cast<size_t>(it - blockIndex.begin()));
+            }
+        }
+    }
+
+    // Decode those blocks in parallel; each writes its part of every file
+    // it overlaps
+    ThreadPool pool(options.threads);
+    const size_t maxInFlight = pool.size() * 2;
+    std::deque<std::future<DecodedBlock>> pending;
+    const uint8_t* input = inputMap ? inputMap->data() : nullptr;
+    uint32_t checksum = 0;
+    size_t finished = 0;
+    auto finishNextBlock = [&]() {
+        StatsClock::time_point waitStart = StatsClock::now();
+        DecodedBlock block = pending.front().get();
+        pending.pop_front();
+        stats.wait += lapSeconds(waitStart);
+        stats.decoder += block.times;
+        checksum = crc32cCombine(checksum, block.checksum, blockIndex[blocks[finished++]].rawSize);
+    };
+    for (size_t b : blocks) {
+        const BlockIndexEntry entry = blockIndex[b];
+        pending.push_back(pool.submit([&archiveFile, &selected, &outputDir, &blockIndex, &location, input, b, entry,
+                                       sharedTable]() {
+            HuffmanDecodeTable decodeTable;
+            DecodedBlock block;
+            block.bytes.resize(entry.rawSize);
+            block.checksum = decodeIndexedBlockAt(archiveFile.get(), input, blockIndex, b, location.dedupWindow,
+                                                  decodeTable, sharedTable, block.bytes.data(), block.times);
+            uint64_t blockEnd = entry.rawOffset + entry.rawSize;
+            auto file = std::lower_bound(selected.begin(), selected.end(), entry.rawOffset,
+                                         [](const ArchiveEntry& file, uint64_t value) {
+                                             return file.offset + file.size <= value;
+                                         });
+            for (; file != selected.end() && file->offset < blockEnd; ++file) {
+                uint64_t begin = std::max(file->offset, entry.rawOffset);
+                uint64_t end = std::min(file->offset + file->size, blockEnd);
+                if (begin < end) {
+                    FileDescriptor output((std::filesystem::path(outputDir) / file->name).string(), O_WRONLY);
+                    writeAt(output.get(), block.bytes.data() + (begin - entry.rawOffset),
+                            static_cast<size_t>(end - begin), begin - file->offset);
+                }
+            }
+            block.bytes = std::vector<ORIGINAL_DATA_TYPE>();
+            return block;
+        }));
+        if (pending.size() >= maxInFlight) {
+            finishNextBlock();
+        }
+    }
+    while (!pending.empty()) {
+        finishNextBlock();
+    }
+    // The whole-data checksum applies once every block was decoded
+    if (blocks.size() == blockIndex.size() && checksum != location.checksum) {
+        throw std::runtime_error("Checksum mismatch: the data does not match the checksum in the trailer");
+    }
+
+    stats.bytesIn = fileSize;
+    for (const ArchiveEntry& entry : selected) {
+        stats.bytesOut += entry.size;
+    }
+    stats.blocks = blocks.size();
+    stats.threads = pool.size();
+    stats.wall = lapSeconds(startTime);
+
+    printStats(std::cerr, stats, options.stats);
+    std::cout << "Extracted " << selected.size() << " files" << std::endl;
+}
+
+void HuffmanDecoder::decodeIndexedBlock(int fd, const uint8_t* input, const std::vector<BlockIndexEntry>& blockIndex,
+                                        size_t number, uint64_t dedupWindow, HuffmanDecodeTable& decodeTable,
+                                        const HuffmanDecodeTable* sharedTable, ORIGINAL_DATA_TYPE* output,
+                                        DecodedBlock& block) {
+    // Read the block unless the whole input is in memory
+    const BlockIndexEntry& entry = blockIndex[number];
+    std::vector<uint8_t> buffer;
+    const uint8_t* compressed;
+    if (input) {
+        compressed = input + entry.compressedOffset;
+    } else {
+        buffer.resize(entry.compressedSize);
+        readAt(fd, buffer.data(), buffer.size(), entry.compressedOffset);
+        compressed = buffer.data();
+    }
+
+    if (loadUint32(compressed) != entry.rawSize ||
+        BLOCK_HEADER_SIZE + loadUint32(compressed + 4) != entry.compressedSize) {
+        throw std::runtime_error("Corrupt block: header does not match the block index");
+    }
+    const uint8_t* payload = compressed + BLOCK_HEADER_SIZE;
+    size_t payloadSize = entry.compressedSize - BLOCK_HEADER_SIZE;
+    block.checksum = loadUint32(compressed + 8);
+    block.reference = referenceDistance(payload, payloadSize, dedupWindow);
+    if (block.reference != 0) {
+        return;
+    }
+
+    // A reused table comes from the head of its block, wherever that is
+    uint64_t distance = recentTableDistance(payload, payloadSize);
+    CodeLengthTable recentTable;
+    if (distance != 0) {
+        StatsClock::time_point fetchStart = StatsClock::now();
+        recentTable = fetchRecentTable(fd, input, blockIndex, number, distance);
+        block.times.table += lapSeconds(fetchStart);
+    }
+    decodeBlock(payload, payloadSize, entry.rawSize, block.checksum, decodeTable, sharedTable,
+                distance != 0 ? &recentTable : nullptr, output, block.times);
+}
+
+CodeLengthTable HuffmanDecoder::fetchRecentTable(int fd, const uint8_t* input,
+                                                 const std::vector<BlockIndexEntry>& blockIndex, size_t number,
+                                                 uint64_t distance) {
+    if (distance > number) {
+        throw std::runtime_error("Corrupt block: reused code table not found");
+    }
+    // Only the mode byte and the code lengths are needed
+    const BlockIndexEntry& source = blockIndex[number - static_cast<size_t>(distance)];
+    size_t headSize = std::min<size_t>(source.compressedSize, BLOCK_HEADER_SIZE + 1 + codeLengthsSize(256));
+    std::vector<uint8_t> buffer;
+    const uint8_t* head;
+    if (input) {
+        head = input + source.compressedOffset;
+    } else {
+        buffer.resize(headSize);
+        readAt(fd, buffer.data(), buffer.size(), source.compressedOffset);
+        head = buffer.data();
+    }
+    CodeLengthTable codeLengths;
+    if (!ownCodeLengths(head + BLOCK_HEADER_SIZE, headSize - BLOCK_HEADER_SIZE, codeLengths)) {
+        throw std::runtime_error("Corrupt block: reused code table not found");
+    }
+    return codeLengths;
+}
+
+uint32_t HuffmanDecoder::decodeIndexedBlockAt(int fd, const uint8_t* input,
+                                              const std::vector<BlockIndexEntry>& blockIndex, size_t number,
+                                              uint64_t dedupWindow, HuffmanDecodeTable& decodeTable,
+                                              const HuffmanDecodeTable* sharedTable, ORIGINAL_DATA_TYPE* output,
+                                              DecoderPhaseTimes& times) {
+    DecodedBlock block;
+    decodeIndexedBlock(fd, input, blockIndex, number, dedupWindow, decodeTable, sharedTable, output, block);
+    uint32_t checksum = block.checksum;
+    uint32_t rawSize = blockIndex[number].rawSize;
+    // The block a reference repeats comes before it, so this ends
+    while (block.reference != 0) {
+        if (block.reference > number) {
+            throw std::runtime_error("Corrupt block: reference out of range");
+        }
+        number -= static_cast<size_t>(block.reference);
+        if (blockIndex[number].rawSize != rawSize) {
+            throw std::runtime_error("Checksum mismatch: block is corrupt");
+        }
+        decodeIndexedBlock(fd, input, blockIndex, number, dedupWindow, decodeTable, sharedTable, output, block);
+    }
+    if (block.checksum != checksum) {
+        throw std::runtime_error("Checksum mismatch: block is corrupt");
+    }
+    times += block.times;
+    return checksum;
+}
+
+uint64_t HuffmanDecoder::referenceDistance(const uint8_t* payload, size_t payloadSize, uint64_t dedupWindow) {
+    if (payloadSize == 0 || payload[0] != BLOCK_MODE_REFERENCE) {
+        return 0;
+    }
+    const uint8_t* cur = payload + 1;
+    const uint8_t* end = payload + payloadSize;
+    uint64_t distance = readVarint(cur, end);
+    if (cur != end || distance == 0 || distance > dedupWindow) {
+        throw std::runtime_error("Corrupt block: reference out of range");
+    }
+    return distance;
+}
+
+uint64_t HuffmanDecoder::recentTableDistance(const uint8_t* payload, size_t payloadSize) {
+    if (payloadSize == 0 || (payload[0] & BLOCK_MODE_RECENT_TABLE) == 0) {
+        return 0;
+    }
+    const uint8_t* cur = payload + 1;
+    uint64_t distance = readVarint(cur, payload + payloadSize);
+    if (distance == 0 || distance > RECENT_TABLE_WINDOW) {
+        throw std::runtime_error("Corrupt block: reused code table out of range");
+    }
+    return distance;
+}
+
+bool HuffmanDecoder::ownCodeLengths(const uint8_t* payload, size_t payloadSize, CodeLengthTable& codeLengths) {
+    if (payloadSize == 0 || (payload[0] != BLOCK_MODE_SINGLE_STREAM && payload[0] != BLOCK_MODE_FOUR_STREAMS)) {
+        return false;
+    }
+    const uint8_t* cur = payload + 1;
+    codeLengths = readCodeLengths(cur, payload + payloadSize);
+    return true;
+}
+
+const HuffmanDecodeTable* HuffmanDecoder::sharedDecodeTable(uint32_t tableId) const {
+    if (tableId == 0) {
+        return nullptr;
+    }
+    if (!options.table) {
+        throw std::runtime_error("Data was compressed with shared table " + std::to_string(tableId) +
+                                 "; pass the table file with -D");
+    }
+    if (options.table->id() != tableId) {
+        throw std::runtime_error("Data was compressed with shared table " + std::to_string(tableId) +
+                                 ", not with table " + std::to_string(options.table->id()));
+    }
+    return &options.table->decodeTable();
+}
+
+void HuffmanDecoder::parseFileHeader(const uint8_t* fileHeader, const std::string& inputPath,
+                                     IndexLocation& location) {
+    // Check the magic bytes and the format version
+    if (std::memcmp(fileHeader, FORMAT_MAGIC, sizeof(FORMAT_MAGIC)) != 0) {
+        throw std::runtime_error("Not an HZip compressed file: " + inputPath);
+    }
+    uint8_t version = fileHeader[sizeof(FORMAT_MAGIC)];
+    if (version != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported format version: " + std::to_string(version));
+    }
+    uint8_t flags = fileHeader[sizeof(FORMAT_MAGIC) + 1];
+    if ((flags & ~FILE_FLAG_DEDUP) != 0) {
+        throw std::runtime_error("Unsupported format flags: " + std::to_string(flags));
+    }
+    location.blockSize = loadUint32(fileHeader + sizeof(FORMAT_MAGIC) + 2);
+    if (location.blockSize == 0 || location.blockSize > MAX_BLOCK_SIZE) {
+        throw std::runtime_error("Invalid block size in file header");
+    }
+    location.tableId = loadUint32(fileHeader + sizeof(FORMAT_MAGIC) + 2 + 4);
+    location.dedupWindow = (flags & FILE_FLAG_DEDUP) != 0 ? dedupWindow(location.blockSize) : 0;
+}
+
+std::vector<BlockIndexEntry> HuffmanDecoder::readBlockIndex(int fd, uint64_t fileSize, const std::string& inputPath,
+                                                            IndexLocation& location) {
+    if (fileSize < FILE_HEADER_SIZE + 4 + TRAILER_SIZE) {
+        throw std::runtime_error("Not an HZip compressed file: " + inputPath);
+    }
+    uint8_t fileHeader[FILE_HEADER_SIZE];
+    uint8_t trailer[TRAILER_SIZE];
+    readAt(fd, fileHeader, sizeof(fileHeader), 0);
+    readAt(fd, trailer, sizeof(trailer), fileSize - TRAILER_SIZE);
+    location = parseTrailer(fileHeader, trailer, fileSize, inputPath);
+
+    std::vector<uint8_t> indexBytes(static_cast<size_t>(location.indexSize));
+    readAt(fd, indexBytes.data(), indexBytes.size(), location.indexOffset);
+    std::vector<BlockIndexEntry> blockIndex;
+    parseIndexEntries(indexBytes.data(), location, blockIndex);
+    return blockIndex;
+}
+
+HuffmanDecoder::IndexLocation HuffmanDecoder::parseTrailer(const uint8_t* fileHeader, const uint8_t* trailer,
+                                                           uint64_t fileSize, const std::string& inputPath) {
+    IndexLocation location;
+    parseFileHeader(fileHeader, inputPath, location);
+
+    // The trailer gives the number of blocks, where the index starts and
+    // the checksum of all the data
+    if (std::memcmp(trailer + 20, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0) {
+        throw std::runtime_error(inputPath + " is an archive; extract it with -d -r");
+    }
+    if (std::memcmp(trailer + 20, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        throw std::runtime_error("Missing block index (truncated file?)");
+    }
+    location.blockCount = loadUint64(trailer);
+    location.indexOffset = loadUint64(trailer + 8);
+    location.checksum = loadUint32(trailer + 16);
+    // Every index entry takes at least two bytes
+    if (location.indexOffset < FILE_HEADER_SIZE + 4 || location.indexOffset > fileSize - TRAILER_SIZE ||
+        location.blockCount > (fileSize - TRAILER_SIZE - location.indexOffset) / 2) {
+        throw std::runtime_error("Corrupt block index");
+    }
+    location.indexSize = fileSize - TRAILER_SIZE - location.indexOffset;
+    return location;
+}
+
+void HuffmanDecoder::parseIndexEntries(const uint8_t* indexBytes, const IndexLocation& location,
+                                       std::vector<BlockIndexEntry>& blockIndex) {
+    // Blocks are contiguous in both the compressed file and the output, so
+    // the offsets are running sums of the sizes
+    blockIndex.resize(static_cast<size_t>(location.blockCount));
+    const uint8_t* cur = indexBytes;
+    const uint8_t* end = indexBytes + location.indexSize;
+    uint64_t compressedOffset = FILE_HEADER_SIZE;
+    uint64_t rawOffset = 0;
+    for (BlockIndexEntry& entry : blockIndex) {
+        uint64_t compressedSize = readVarint(cur, end);
+        uint64_t rawSize = readVarint(cur, end);
+        if (rawSize == 0 || rawSize > location.blockSize || compressedSize < BLOCK_HEADER_SIZE ||
+            compressedSize > BLOCK_HEADER_SIZE + maxPayloadSize(static_cast<uint32_t>(rawSize))) {
+            throw std::runtime_error("Corrupt block index");
+        }
+        entry.compressedOffset = compressedOffset;
+        entry.compressedSize = static_cast<uint32_t>(compressedSize);
+        entry.rawOffset = rawOffset;
+        entry.rawSize = static_cast<uint32_t>(rawSize);
+        compressedOffset += compressedSize;
+        rawOffset += rawSize;
+    }
+    if (cur != end || compressedOffset + 4 != location.indexOffset) {
+        throw std::runtime_error("Corrupt block index");
+    }
+}
+
+HuffmanDecoder::IndexLocation HuffmanDecoder::parseBufferIndex(const uint8_t* src, size_t srcSize,
+                                                                std::vector<BlockIndexEntry>& blockIndex) {
+    if (srcSize < FILE_HEADER_SIZE + 4 + TRAILER_SIZE) {
+        throw std::runtime_error("Not an HZip compressed buffer");
+    }
+    IndexLocation location = parseTrailer(src, src + srcSize - TRAILER_SIZE, srcSize, "buffer");
+    parseIndexEntries(src + location.indexOffset, location, blockIndex);
+    return location;
+}
+
+uint64_t HuffmanDecoder::decompressedSize(const uint8_t* src, size_t srcSize) {
+    // The validated index ends where the data does
+    std::vector<BlockIndexEntry> blockIndex;
+    parseBufferIndex(src, srcSize, blockIndex);
+    return blockIndex.empty() ? 0 : blockIndex.back().rawOffset + blockIndex.back().rawSize;
+}
+
+size_t HuffmanDecoder::decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity) {
+    IndexLocation location = parseBufferIndex(src, srcSize, bufferIndex);
+    uint64_t totalSize = bufferIndex.empty() ? 0 : bufferIndex.back().rawOffset + bufferIndex.back().rawSize;
+    if (totalSize > dstCapacity) {
+        throw std::length_error("Output buffer too small: " + std::to_string(totalSize) + " bytes needed");
+    }
+    decodeBuffer(src, location, dst);
+    return static_cast<size_t>(totalSize);
+}
+
+void HuffmanDecoder::decompress(const uint8_t* src, size_t srcSize, std::vector<ORIGINAL_DATA_TYPE>& dst) {
+    IndexLocation location = parseBufferIndex(src, srcSize, bufferIndex);
+    uint64_t totalSize = bufferIndex.empty() ? 0 : bufferIndex.back().rawOffset + bufferIndex.back().rawSize;
+    dst.resize(static_cast<size_t>(totalSize));
+    decodeBuffer(src, location, dst.data());
+}
+
+void HuffmanDecoder::decodeBuffer(const uint8_t* src, const IndexLocation& location, uint8_t* dst) {
+    const HuffmanDecodeTable* sharedTable = sharedDecodeTable(location.tableId);
+    phaseTimes = DecoderPhaseTimes();
+
+    // Reference blocks copy the block they repeat from dst
+    uint32_t checksum = 0;
+    DedupHistory history(location.dedupWindow, false);
+    DecodedBlock block;
+    for (size_t number = 0; number < bufferIndex.size(); ++number) {
+        const BlockIndexEntry& entry = bufferIndex[number];
+        decodeIndexedBlock(-1, src, bufferIndex, number, location.dedupWindow, decodeTable, sharedTable,
+                           dst + entry.rawOffset, block);
+        if (block.reference != 0) {
+            uint64_t source = history.source(history.count(), block.reference, entry.rawSize, block.checksum);
+            std::memcpy(dst + entry.rawOffset, dst + bufferIndex[source].rawOffset, entry.rawSize);
+        }
+        checksum = crc32cCombine(checksum, block.checksum, entry.rawSize);
+        history.add(entry.rawSize, block.checksum, block.bytes);
+    }
+    phaseTimes = block.times;
+    if (checksum != location.checksum) {
+        throw std::runtime_error("Checksum mismatch: the data does not match the checksum in the trailer");
+    }
+}
+
+void HuffmanDecoder::decodeBlock(const uint8_t* payload, size_t payloadSize, uint32_t rawSize, uint32_t checksum,
+                                 HuffmanDecodeTable& decodeTable, const HuffmanDecodeTable* sharedTable,
+                                 const CodeLengthTable* recentTable, ORIGINAL_DATA_TYPE* output,
+                                 DecoderPhaseTimes& times) {
+    StatsClock::time_point phaseStart = StatsClock::now();
+    const uint8_t* cur = payload;
+    const uint8_t* end = payload + payloadSize;
+    if (cur == end) {
+        throw std::runtime_error("Unable to read block mode");
+    }
+    uint8_t mode = *cur++;
+    size_t dataSize = static_cast<size_t>(end - cur);
+    if (mode == BLOCK_MODE_STORED || mode == BLOCK_MODE_RLE) {
+        if (dataSize != (mode == BLOCK_MODE_STORED ? rawSize : 1)) {
+            throw std::runtime_error("Corrupt block: wrong payload size");
+        }
+        // Stored blocks are copied and checksummed in one pass; a run needs
+        // no pass over the data for its checksum
+        uint32_t actual;
+        if (mode == BLOCK_MODE_STORED) {
+            actual = crc32cCopy(output, cur, rawSize);
+        } else {
+            std::memset(output, *cur, rawSize);
+            actual = crc32cRun(*cur, rawSize);
+        }
+        times.decode += lapSeconds(phaseStart);
+        if (actual != checksum) {
+            throw std::runtime_error("Checksum mismatch: block is corrupt");
+        }
+        return;
+    }
+    if (mode == BLOCK_MODE_TANS) {
+        int tableLog = 0;
+        NormalizedCounts counts = readNormalizedCounts(cur, end, tableLog);
+        TansDecodeTable tansTable;
+        tansTable.build(counts, tableLog);
+        times.table += lapSeconds(phaseStart);
+        tansTable.decode(cur, static_cast<size_t>(end - cur), rawSize, output);
+        times.decode += lapSeconds(phaseStart);
+        verifyChecksum(output, rawSize, checksum, times);
+        return;
+    }
+    bool shared = (mode & BLOCK_MODE_SHARED_TABLE) != 0;
+    bool recent = (mode & BLOCK_MODE_RECENT_TABLE) != 0;
+    mode &= static_cast<uint8_t>(~(BLOCK_MODE_SHARED_TABLE | BLOCK_MODE_RECENT_TABLE));
+    if ((mode != BLOCK_MODE_SINGLE_STREAM && mode != BLOCK_MODE_FOUR_STREAMS) || (shared && recent)) {
+        throw std::runtime_error("Unknown block mode: " + std::to_string(payload[0]));
+    }
+
+    // Use the shared table, the code lengths of an earlier block, or read
+    // the code lengths; the latter two build the decode table
+    const HuffmanDecodeTable* table = sharedTable;
+    if (shared) {
+        if (!sharedTable) {
+            throw std::runtime_error("Corrupt block: shared table used but not named in the file header");
+        }
+    } else if (recent) {
+        if (!recentTable) {
+            throw std::runtime_error("Corrupt block: reused code table not found");
+        }
+        readVarint(cur, end);
+        decodeTable.build(*recentTable);
+        table = &decodeTable;
+    } else {
+        CodeLengthTable codeLengths = readCodeLengths(cur, end);
+        decodeTable.build(codeLengths);
+        table = &decodeTable;
+    }
+    times.table += lapSeconds(phaseStart);
+
+    // The encoded data runs to the end of the payload
+    if (mode == BLOCK_MODE_FOUR_STREAMS) {
+        decodeFourStreams(cur, static_cast<size_t>(end - cur), rawSize, *table, output);
+    } else {
+        BitReader bitReader(cur, static_cast<size_t>(end - cur));
+        decodeData(bitReader, rawSize, *table, output);
+    }
+    times.decode += lapSeconds(phaseStart);
+    verifyChecksum(output, rawSize, checksum, times);
+}
+
+void HuffmanDecoder::verifyChecksum(const ORIGINAL_DATA_TYPE* data, uint32_t size, uint32_t checksum,
+                                    DecoderPhaseTimes& times) {
+    // Runs right after decoding, while the block is still in cache
+    StatsClock::time_point phaseStart = StatsClock::now();
+    bool match = crc32c(data, size) == checksum;
+    times.checksum += lapSeconds(phaseStart);
+    if (!match) {
+        throw std::runtime_error("Checksum mismatch: block is corrupt");
+    }
+}
+
+namespace {
+
+// Decode one table entry into `output`, which must have room for
+// MAX_SYMBOLS_PER_ENTRY bytes, and return the number of symbols
+inline uint32_t decodeEntry(BitReader& bitReader, const HuffmanDecodeTable& decodeTable, ORIGINAL_DATA_TYPE* output) {
+    bitReader.refill();
+    const HuffmanDecodeTable::Entry& entry = decodeTable.lookup(bitReader.peekBits(HuffmanDecodeTable::LOOKUP_BITS));
+    if (entry.symbolCount > 0) {
+        std::memcpy(output, entry.symbols, HuffmanDecodeTable::MAX_SYMBOLS_PER_ENTRY);
+        bitReader.consumeBits(entry.bitLength);
+        return entry.symbolCount;
+    }
+    int length = decodeTable.decodeLong(bitReader.peekBits(MAX_CODE_LENGTH_LIMIT), output[0]);
+    if (length == 0) {
+        throw std::runtime_error("Decoding error: invalid bit sequence");
+    }
+    bitReader.consumeBits(length);
+    return 1;
+}
+
+} // namespace
+
+void HuffmanDecoder::decodeFourStreams(const uint8_t* data, size_t dataSize, uint32_t rawSize,
+                                       const HuffmanDecodeTable& decodeTable, ORIGINAL_DATA_TYPE* output) {
+    // Jump table: byte sizes of the first three streams; the last stream
+    // runs to the end of the data
+    if (dataSize < STREAM_JUMP_TABLE_SIZE) {
+        throw std::runtime_error("Unable to read stream jump table");
+    }
+    size_t streamSizes[STREAM_COUNT];
+    size_t used = STREAM_JUMP_TABLE_SIZE;
+    for (int s = 0; s < STREAM_COUNT - 1; ++s) {
+        streamSizes[s] = loadUint32(data + 4 * s);
+        used += streamSizes[s];
+    }
+    if (used > dataSize) {
+        throw std::runtime_error("Corrupt stream jump table");
+    }
+    streamSizes[STREAM_COUNT - 1] = dataSize - used;
+
+    const uint8_t* streamData = data + STREAM_JUMP_TABLE_SIZE;
+    BitReader reader0(streamData, streamSizes[0]);
+    BitReader reader1(streamData + streamSizes[0], streamSizes[1]);
+    BitReader reader2(streamData + streamSizes[0] + streamSizes[1], streamSizes[2]);
+    BitReader reader3(streamData + streamSizes[0] + streamSizes[1] + streamSizes[2], streamSizes[3]);
+
+    uint32_t segment = (rawSize + STREAM_COUNT - 1) / STREAM_COUNT;
+    ORIGINAL_DATA_TYPE* out0 = output;
+    ORIGINAL_DATA_TYPE* out1 = output + segment;
+    ORIGINAL_DATA_TYPE* out2 = output + 2 * segment;
+    ORIGINAL_DATA_TYPE* out3 = output + 3 * segment;
+    ORIGINAL_DATA_TYPE* const end0 = out1;
+    ORIGINAL_DATA_TYPE* const end1 = out2;
+    ORIGINAL_DATA_TYPE* const end2 = out3;
+    ORIGINAL_DATA_TYPE* const end3 = output + rawSize;
+
+    // Lockstep: one entry from every stream per round. An entry yields at
+    // most MAX_SYMBOLS_PER_ENTRY symbols, so the rounds below cannot write
+    // past the shortest remaining segment.
+    constexpr uint32_t maxSymbols = HuffmanDecodeTable::MAX_SYMBOLS_PER_ENTRY;
+    for (;;) {
+        size_t shortest = std::min(std::min(end0 - out0, end1 - out1), std::min(end2 - out2, end3 - out3));
+        size_t rounds = shortest / maxSymbols;
+        if (rounds == 0) {
+            break;
+        }
+        for (size_t r = 0; r < rounds; ++r) {
+            out0 += decodeEntry(reader0, decodeTable, out0);
+            out1 += decodeEntry(reader1, decodeTable, out1);
+            out2 += decodeEntry(reader2, decodeTable, out2);
+            out3 += decodeEntry(reader3, decodeTable, out3);
+        }
+        if (reader0.exhausted() || reader1.exhausted() || reader2.exhausted() || reader3.exhausted()) {
+            throw std::runtime_error("Decoding error: unexpected end of data");
+        }
+    }
+
+    // Finish each stream on its own
+    decodeData(reader0, static_cast<uint32_t>(end0 - out0), decodeTable, out0);
+    decodeData(reader1, static_cast<uint32_t>(end1 - out1), decodeTable, out1);
+    decodeData(reader2, static_cast<uint32_t>(end2 - out2), decodeTable, out2);
+    decodeData(reader3, static_cast<uint32_t>(end3 - out3), decodeTable, out3);
+}
+
+void HuffmanDecoder::decodeData(BitReader& bitReader, uint32_t totalChars, const HuffmanDecodeTable& decodeTable,
+                                ORIGINAL_DATA_TYPE* output) {
+    constexpr int LOOKUP_BITS = HuffmanDecodeTable::LOOKUP_BITS;
+
+    // Symbols are copied a whole entry at a time while at least that much
+    // room is left; the tail is written symbol by symbol so nothing past
+    // output[totalChars - 1] is touched
+    uint32_t decodedChars = 0;
+    while (decodedChars < totalChars) {
+        bitReader.refill();
+        const HuffmanDecodeTable::Entry& entry = decodeTable.lookup(bitReader.peekBits(LOOKUP_BITS));
+        if (entry.symbolCount > 0) {
+            uint32_t remaining = totalChars - decodedChars;
+            if (remaining >= HuffmanDecodeTable::MAX_SYMBOLS_PER_ENTRY) {
+                std::memcpy(output + decodedChars, entry.symbols, HuffmanDecodeTable::MAX_SYMBOLS_PER_ENTRY);
+                decodedChars += entry.symbolCount;
+            } else {
+                uint32_t count = std::min<uint32_t>(entry.symbolCount, remaining);
+                for (uint32_t i = 0; i < count; ++i) {
+                    output[decodedChars++] = entry.symbols[i];
+                }
+            }
+            bitReader.consumeBits(entry.bitLength);
+        } else {
+            // Code longer than the lookup width
+            ORIGINAL_DATA_TYPE symbol;
+            int length = decodeTable.decodeLong(bitReader.peekBits(MAX_CODE_LENGTH_LIMIT), symbol);
+            if (length == 0) {
+                throw std::runtime_error("Decoding error: invalid bit sequence");
+            }
+            output[decodedChars++] = symbol;
+            bitReader.consumeBits(length);
+        }
+
+        // A final entry may have been cut short by totalChars, in which case
+        // its trailing bits are padding and need not be present
+        if (decodedChars < totalChars && bitReader.exhausted()) {
+            throw std::runtime_error("Decoding error: unexpected end of data");
+        }
+    }
+}
+
+CodeLengthTable HuffmanDecoder::readCodeLengths(const uint8_t*& cur, const uint8_t* end) {
+    // Number of symbols that occur, minus one (1 byte)
+    if (cur == end) {
+        throw std::runtime_error("Unable to read symbol count");
+    }
+    size_t symbolCount = static_cast<size_t>(*cur++) + 1;
+
+    // The symbols: a plain list for short alphabets, a presence bitmap otherwise
+    std::vector<uint8_t> symbols;
+    if (symbolCount < SYMBOL_BITMAP_SIZE) {
+        if (static_cast<size_t>(end - cur) < symbolCount) {
+            throw std::runtime_error("Unable to read symbol list");
+        }
+        symbols.assign(cur, cur + symbolCount);
+        cur += symbolCount;
+    } else {
+        if (static_cast<size_t>(end - cur) < SYMBOL_BITMAP_SIZE) {
+            throw std::runtime_error("Unable to read symbol bitmap");
+        }
+        for (int ch = 0; ch < 256; ++ch) {
+            if (cur[ch / 8] & (0x80 >> (ch % 8))) {
+                symbols.push_back(static_cast<uint8_t>(ch));
+            }
+        }
+        cur += SYMBOL_BITMAP_SIZE;
+        if (symbols.size() != symbolCount) {
+            throw std::runtime_error("Symbol bitmap does not match symbol count");
+        }
+    }
+
+    // Code lengths of the present symbols, two 4-bit lengths per byte
+    size_t packedSize = (symbolCount + 1) / 2;
+    if (static_cast<size_t>(end - cur) < packedSize) {
+        throw std::runtime_error("Unable to read code lengths");
+    }
+
+    CodeLengthTable codeLengths{};
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        uint8_t byte = cur[i / 2];
+        uint8_t len = (i % 2 == 0) ? (byte >> 4) : (byte & 0x0F);
+        if (len == 0 || codeLengths[symbols[i]] != 0) {
+            throw std::runtime_error("Invalid code length table");
+        }
+        codeLengths[symbols[i]] = len;
+    }
+    cur += packedSize;
+    return codeLengths;
+}
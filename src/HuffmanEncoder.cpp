@@ -1,195 +1,1047 @@
-// src/HuffmanEncoder.cpp
-#include "HuffmanEncoder.h"
-#include "HuffmanTree.h"
-#include "BitIO.h"
-#include <fstream>
-#include <stdexcept>
-#include <iostream>
-#include <filesystem>
-#include <iomanip> // For std::hex and std::dec
-
-namespace fs = std::filesystem;
-
-// Utility function declaration (assumed to be in Utils.h)
-std::string getAbsolutePath(const std::string& filename);
-
-void HuffmanEncoder::compress(const std::string& inputPath, const std::string& outputPath) {
-    // Get the original file size
-    size_t originalSize = 0;
-    try {
-        originalSize = fs::file_size(inputPath);
-    } catch (const fs::filesystem_error& e) {
-        throw std::runtime_error("Unable to get input file size: " + std::string(e.what()));
-    }
-
-    // Read the input file and count character frequencies
-    std::ifstream inputFile(inputPath, std::ios::binary);
-    if (!inputFile.is_open()) {
-        throw std::runtime_error("Unable to open input file: " + inputPath);
-    }
-
-    std::unordered_map<ORIGINAL_DATA_TYPE, int> frequencyMap;
-    int totalChars = 0;
-    ORIGINAL_DATA_TYPE ch;
-    while (inputFile.read(reinterpret_cast<char*>(&ch), sizeof(ORIGINAL_DATA_TYPE))) {
-        frequencyMap[ch]++;
-        totalChars++;
-    }
-
-    if (totalChars == 0) {
-        throw std::runtime_error("Input file is empty");
-    }
-
-    // Print character frequencies to standard error
-    std::cerr << "Character frequency statistics:\n";
-    for (const auto& [charKey, freq] : frequencyMap) {
-        if (std::isprint(charKey)) {
-            std::cerr << " '" << charKey << "': " << freq << "\n";
-        } else {
-            std::cerr << " '\\x" << std::hex << static_cast<int>(charKey) << std::dec << "': " << freq << "\n";
-        }
-    }
-
-    // Build Huffman tree and generate code table
-    HuffmanTree tree;
-    tree.buildTree(frequencyMap);
-    tree.generateCodeTable();
-
-    // Print Huffman code table to standard error
-    std::cerr << "\nHuffman code table:\n";
-    for (const auto& [charKey, code] : tree.codeTable) {
-        if (std::isprint(charKey)) {
-            std::cerr << " '" << charKey << "': ";
-        } else {
-            std::cerr << " '\\x" << std::hex << static_cast<int>(charKey) << std::dec << "': ";
-        }
-        for (bool bit : code) {
-            std::cerr << bit;
-        }
-        std::cerr << "\n";
-    }
-
-    // Calculate header size
-    size_t headerSize = 1 + 4; // tableSize (1 byte) + totalChars (4 bytes)
-    for (const auto& [charKey, code] : tree.codeTable) {
-        headerSize += 1 + 1; // character (1 byte) + codeLength (1 byte)
-        headerSize += (code.size() + 7) / 8; // packed code bits
-    }
-
-    // Calculate compressed data size (in bits)
-    size_t compressedDataBits = 0;
-    for (const auto& [charKey, freq] : frequencyMap) {
-        compressedDataBits += freq * tree.codeTable[charKey].size();
-    }
-    size_t compressedDataBytes = (compressedDataBits + 7) / 8; // Round up
-    compressedDataBytes += 1; // padding byte
-
-    size_t totalCompressedSize = headerSize + compressedDataBytes;
-
-    // Compare compressed size with original file size
-    if (totalCompressedSize >= originalSize) {
-        // Skip compression and copy the original file to the output file
-        std::cerr << "\nCompressed file size (" << totalCompressedSize << " bytes) is not smaller than the original file size (" << originalSize << " bytes).\n";
-        std::cerr << "Skipping compression and copying the original file to the output file.\n";
-
-        // Rewind to the beginning of the file
-        inputFile.clear();
-        inputFile.seekg(0, std::ios::beg);
-
-        // Open the output file
-        std::ofstream outputFile(outputPath, std::ios::binary);
-        if (!outputFile.is_open()) {
-            throw std::runtime_error("Unable to open output file: " + outputPath);
-        }
-
-        // Copy file content
-        outputFile << inputFile.rdbuf();
-
-        // Close files
-        inputFile.close();
-        outputFile.close();
-
-        return;
-    }
-
-    // Open the output file
-    std::ofstream outputFile(outputPath, std::ios::binary);
-    if (!outputFile.is_open()) {
-        throw std::runtime_error("Unable to open output file: " + outputPath);
-    }
-
-    // Write the size of the code table (1 byte)
-    uint8_t tableSize = static_cast<uint8_t>(tree.codeTable.size());
-    outputFile.write(reinterpret_cast<const char*>(&tableSize), sizeof(uint8_t));
-
-    // Write the total number of characters (4 bytes)
-    outputFile.write(reinterpret_cast<const char*>(&totalChars), sizeof(int));
-
-    // Write the code table
-    for (const auto& [charKey, code] : tree.codeTable) {
-        // Write the character (1 byte)
-        outputFile.write(reinterpret_cast<const char*>(&charKey), sizeof(ORIGINAL_DATA_TYPE));
-
-        // Write the code length (1 byte)
-        uint8_t codeLength = static_cast<uint8_t>(code.size());
-        outputFile.write(reinterpret_cast<const char*>(&codeLength), sizeof(uint8_t));
-
-        // Pack the code bits into bytes
-        std::vector<uint8_t> packedBytes = packBits(code);
-
-        // Write the packed bytes
-        if (!packedBytes.empty()) {
-            outputFile.write(reinterpret_cast<const char*>(packedBytes.data()), packedBytes.size());
-        }
-    }
-
-    // Use BitWriter to write the encoded data
-    BitWriter bitWriter(outputFile);
-
-    // Rewind to the beginning of the file
-    inputFile.clear();
-    inputFile.seekg(0, std::ios::beg);
-
-    // Write the encoded data to the buffer
-    while (inputFile.read(reinterpret_cast<char*>(&ch), sizeof(ORIGINAL_DATA_TYPE))) {
-        const auto& code = tree.codeTable[ch];
-        bitWriter.writeBits(code);
-    }
-
-    // Flush the buffer and get the number of padding bits
-    int padding = bitWriter.getBitCount() > 0 ? (8 - bitWriter.getBitCount()) : 0;
-    bitWriter.flush();
-
-    // Write the number of padding bits (1 byte)
-    uint8_t paddingByte = static_cast<uint8_t>(padding);
-    outputFile.write(reinterpret_cast<const char*>(&paddingByte), sizeof(uint8_t));
-
-    // Close files
-    inputFile.close();
-    outputFile.close();
-
-    // Calculate and print compression ratio and header size to standard error
-    double compressionRatio = (static_cast<double>(totalCompressedSize) / static_cast<double>(originalSize)) * 100.0;
-
-    std::cerr << "\nCompression complete!\n";
-    std::cerr << "Input file size: " << originalSize << " bytes\n";
-    std::cerr << "Header size: " << headerSize << " bytes\n";
-    std::cerr << "Compressed file size: " << totalCompressedSize << " bytes\n";
-    std::cerr << "Compression ratio: " << std::fixed << std::setprecision(2) << compressionRatio << "%\n";
-}
-
-std::vector<uint8_t> HuffmanEncoder::packBits(const std::vector<bool>& bits) {
-    std::vector<uint8_t> packedBytes;
-    size_t i = 0;
-    while (i < bits.size()) {
-        uint8_t byte = 0;
-        for (int bit = 0; bit < 8; ++bit) {
-            byte <<= 1;
-            if (i < bits.size()) {
-                byte |= bits[i++] ? 1 : 0;
-            }
-        }
-        packedBytes.push_back(byte);
-    }
-    return packedBytes;
-}
+// src/HuffmanEncoder.cpp
+#include "HuffmanEncoder.h"
+#include "HuffmanTree.h"
+#include "BitIO.h"
+#include "Format.h"
+#include "ThreadPool.h"
+#include "BlockPipeline.h"
+#include "MappedFile.h"
+#include "Utils.h"
+#include "Histogram.h"
+#include "Checksum.h"
+#include "Archive.h"
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip> // For std::hex and std::dec
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <filesystem>
+#include <deque>
+#include <unordered_map>
+#include <fcntl.h>
+
+namespace {
+
+// Last bits of a chunk that share a byte with the following chunk
+struct ChunkTail {
+    size_t index = 0;
+    uint8_t bits = 0;
+};
+
+// Code data[0, size) into the bit range of out starting at bitOffset, most
+// significant bit first like BitWriter. Only bytes the chunk completes are
+// stored; its partial last byte is returned so that neighbouring chunks never
+// write the same byte.
+ChunkTail encodeChunk(uint8_t* out, uint64_t bitOffset, const ORIGINAL_DATA_TYPE* data, size_t size,
+                      const CodeTable& codeTable, const PairCodeTable* pairCodes) {
+    uint8_t* dst = out + bitOffset / 8;
+    uint64_t bitBuffer = 0;
+    // Zero bits stand in for the previous chunk's bits in the first byte
+    int bitCount = static_cast<int>(bitOffset % 8);
+    auto put = [&](uint32_t code, int length) {
+        bitBuffer = (bitBuffer << length) | code;
+        bitCount += length;
+        if (bitCount >= 32) {
+            uint32_t word = static_cast<uint32_t>(bitBuffer >> (bitCount - 32));
+            dst[0] = static_cast<uint8_t>(word >> 24);
+            dst[1] = static_cast<uint8_t>(word >> 16);
+            dst[2] = static_cast<uint8_t>(word >> 8);
+            dst[3] = static_cast<uint8_t>(word);
+            dst += 4;
+            bitCount -= 32;
+        }
+    };
+    size_t i = 0;
+    if (pairCodes) {
+        for (; i + 1 < size; i += 2) {
+            const PairCode& pair = (*pairCodes)[(data[i] << 8) | data[i + 1]];
+            put(pair.code, static_cast<int>(pair.length));
+        }
+    }
+    for (; i < size; ++i) {
+        const HuffmanCode& code = codeTable[data[i]];
+        put(code.code, code.length);
+    }
+    while (bitCount >= 8) {
+        *dst++ = static_cast<uint8_t>(bitBuffer >> (bitCount - 8));
+        bitCount -= 8;
+    }
+    ChunkTail tail;
+    tail.index = static_cast<size_t>(dst - out);
+    if (bitCount > 0) {
+        tail.bits = static_cast<uint8_t>(bitBuffer << (8 - bitCount));
+    }
+    return tail;
+}
+
+} // namespace
+
+namespace fs = std::filesystem;
+
+void HuffmanEncoder::compress(const std::string& inputPath, const std::string& outputPath) {
+    RunStats stats;
+    stats.operation = "compress";
+    StatsClock::time_point startTime = StatsClock::now();
+
+    // "-" reads standard input. Otherwise map the input when possible; the
+    // per-block passes then work directly on the page cache
+    std::unique_ptr<FileDescriptor> inputFile;
+    std::unique_ptr<MappedFile> inputMap;
+    if (!isStandardStream(inputPath)) {
+        inputFile = std::make_unique<FileDescriptor>(inputPath, O_RDONLY);
+        inputMap = MappedFile::tryMap(inputFile->get(), inputFile->size(), false);
+    }
+
+    // Open the output file ("-" writes to standard output). Everything is
+    // written front to back, so the output may be a pipe.
+    std::ofstream outputFileStream;
+    std::ostream* outputStream = &std::cout;
+    if (!isStandardStream(outputPath)) {
+        outputFileStream.open(outputPath, std::ios::binary);
+        if (!outputFileStream.is_open()) {
+            throw std::runtime_error("Unable to open output file: " + outputPath);
+        }
+        outputStream = &outputFileStream;
+    }
+
+    // With fewer blocks than coders, each block gets a share of the idle
+    // cores for its histogram and single-stream coding
+    unsigned coders = ThreadPool::resolveThreadCount(options.threads);
+    unsigned blockThreads = 1;
+    std::ifstream inputFileStream;
+    std::istream* inputStream = &std::cin;
+    if (inputMap) {
+        uint64_t blockCount = (inputMap->size() + options.blockSize - 1) / options.blockSize;
+        if (blockCount > 0 && blockCount < coders) {
+            blockThreads = coders / static_cast<unsigned>(blockCount);
+        }
+        inputMap->adviseSequential();
+    } else if (inputFile) {
+        // Buffered fallback for inputs that cannot be mapped (pipes, devices)
+        inputFileStream.open(inputPath, std::ios::binary);
+        if (!inputFileStream.is_open()) {
+            throw std::runtime_error("Unable to open input file: " + inputPath);
+        }
+        inputStream = &inputFileStream;
+    }
+
+    uint64_t readOffset = 0;
+    auto readBlock = [&](PipelineBlock& job) {
+        if (inputMap) {
+            // Mapped input needs no copy; the coder reads the page cache
+            if (readOffset >= inputMap->size()) {
+                return false;
+            }
+            job.data = inputMap->data() + readOffset;
+            job.size = static_cast<size_t>(std::min<uint64_t>(options.blockSize, inputMap->size() - readOffset));
+            readOffset += job.size;
+            return true;
+        }
+        StatsClock::time_point readStart = StatsClock::now();
+        job.input.resize(options.blockSize);
+        inputStream->read(reinterpret_cast<char*>(job.input.data()), job.input.size());
+        job.size = static_cast<size_t>(inputStream->gcount());
+        job.data = job.input.data();
+        stats.read += lapSeconds(readStart);
+        return job.size > 0;
+    };
+    StreamSummary summary;
+    writeStream(*outputStream, outputPath, readBlock, blockThreads, stats, summary);
+    stats.wall = lapSeconds(startTime);
+
+    // Status goes to standard error when the data goes to standard output
+    std::ostream& status = isStandardStream(outputPath) ? std::cerr : std::cout;
+    if (options.verbose) {
+        printSummary(std::cerr, summary.frequencies, stats, summary.headerSize);
+    }
+    printStats(std::cerr, stats, options.stats);
+    status << "Compression complete!" << std::endl;
+}
+
+void HuffmanEncoder::compressArchive(const std::string& inputDir, const std::string& archivePath) {
+    RunStats stats;
+    stats.operation = "compress";
+    StatsClock::time_point startTime = StatsClock::now();
+
+    std::vector<std::string> names = listArchiveFiles(inputDir);
+    std::vector<ArchiveEntry> entries(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        entries[i].name = names[i];
+    }
+
+    // Open the archive ("-" writes to standard output)
+    std::ofstream outputFileStream;
+    std::ostream* outputStream = &std::cout;
+    if (!isStandardStream(archivePath)) {
+        outputFileStream.open(archivePath, std::ios::binary);
+        if (!outputFileStream.is_open()) {
+            throw std::runtime_error("Unable to open output file: " + archivePath);
+        }
+        outputStream = &outputFileStream;
+    }
+
+    // The files are read back to back into full blocks, so small files share
+    // blocks and code tables, and a large file is spread over every coder
+    // like any other input. Sizes are counted as the files are read.
+    size_t fileIndex = 0;
+    std::unique_ptr<FileDescriptor> inputFile;
+    uint64_t streamOffset = 0;
+    auto readBlock = [&](PipelineBlock& job) {
+        StatsClock::time_point readStart = StatsClock::now();
+        job.input.resize(options.blockSize);
+        job.size = 0;
+        while (job.size < job.input.size() && fileIndex < entries.size()) {
+            ArchiveEntry& entry = entries[fileIndex];
+            if (!inputFile) {
+                inputFile = std::make_unique<FileDescriptor>((fs::path(inputDir) / entry.name).string(), O_RDONLY);
+                entry.offset = streamOffset;
+            }
+            size_t got = readSome(inputFile->get(), job.input.data() + job.size, job.input.size() - job.size);
+            if (got == 0) {
+                inputFile.reset();
+                fileIndex++;
+            }
+            job.size += got;
+            entry.size += got;
+            streamOffset += got;
+        }
+        job.data = job.input.data();
+        stats.read += lapSeconds(readStart);
+        return job.size > 0;
+    };
+    StreamSummary summary;
+    writeStream(*outputStream, archivePath, readBlock, 1, stats, summary);
+
+    // The directory follows the compressed stream
+    std::vector<uint8_t> directory;
+    appendArchiveDirectory(directory, entries, stats.bytesOut);
+    if (!outputStream->write(reinterpret_cast<const char*>(directory.data()), directory.size()) ||
+        !outputStream->flush()) {
+        throw std::runtime_error("Unable to write output file: " + archivePath);
+    }
+    stats.bytesOut += directory.size();
+    stats.wall = lapSeconds(startTime);
+
+    std::ostream& status = isStandardStream(archivePath) ? std::cerr : std::cout;
+    if (options.verbose) {
+        printSummary(std::cerr, summary.frequencies, stats, summary.headerSize + directory.size());
+    }
+    printStats(std::cerr, stats, options.stats);
+    status << "Archived " << entries.size() << " files" << std::endl;
+}
+
+void HuffmanEncoder::writeStream(std::ostream& output, const std::string& outputPath, const BlockReader& read,
+                                 unsigned blockThreads, RunStats& stats, StreamSummary& summary) const {
+    std::vector<uint8_t> fileHeader;
+    appendFileHeader(fileHeader);
+    output.write(reinterpret_cast<const char*>(fileHeader.data()), fileHeader.size());
+
+    // Blocks go through a reader, coder and writer pipeline so that reading
+    // and writing overlap the coding. Only a bounded number of blocks is in
+    // flight at any time.
+    unsigned coders = ThreadPool::resolveThreadCount(options.threads);
+    std::vector<BlockIndexEntry> blockIndex;
+    uint64_t compressedOffset = FILE_HEADER_SIZE;
+    uint64_t rawOffset = 0;
+    uint32_t checksum = 0;
+    std::vector<uint32_t> checksums;
+    summary.headerSize = FILE_HEADER_SIZE;
+
+    // With dedup the reader looks every block up by its fingerprint before
+    // queueing it, so a repeat of one of the last `window` blocks costs a
+    // hash instead of a histogram and coding pass. Only the first block with
+    // a given fingerprint is in the table, so references never point at
+    // other references.
+    const uint64_t window = dedupWindow(options.blockSize);
+    std::unordered_map<uint64_t, uint64_t> fingerprints;
+    std::deque<std::pair<uint64_t, uint64_t>> tableOrder;
+    uint64_t readCount = 0;
+    auto readBlock = [&](PipelineBlock& job) {
+        if (!read(job)) {
+            return false;
+        }
+        job.number = readCount;
+        job.reference = 0;
+        if (options.dedup && job.size >= DEDUP_MIN_BLOCK_SIZE) {
+            StatsClock::time_point dedupStart = StatsClock::now();
+            while (!tableOrder.empty() && readCount - tableOrder.front().second > window) {
+                fingerprints.erase(tableOrder.front().first);
+                tableOrder.pop_front();
+            }
+            uint64_t fingerprint = hash64(job.data, job.size);
+            auto found = fingerprints.find(fingerprint);
+            if (found != fingerprints.end()) {
+                job.reference = readCount - found->second;
+            } else {
+                fingerprints.emplace(fingerprint, readCount);
+                tableOrder.emplace_back(fingerprint, readCount);
+            }
+            stats.dedup += lapSeconds(dedupStart);
+        }
+        readCount++;
+        return true;
+    };
+    // Coders take their turn in recentTables in block order; references
+    // take it too, without a table
+    RecentTables recentTables;
+    auto codeBlock = [this, blockThreads, &recentTables](PipelineBlock& job) {
+        if (job.reference != 0) {
+            recentTables.tablesFor(job.number);
+            recentTables.publish(job.number, nullptr);
+            encodeReference(job.encoded, job.data, job.size, job.reference);
+        } else {
+            encodeBlock(job.encoded, job.scratch, job.data, job.size, recentTables, job.number, blockThreads);
+        }
+    };
+    auto writeBlock = [&](PipelineBlock& job) {
+        // The size and checksum of the earlier block confirm a fingerprint
+        // match; after a hash collision the block is stored instead, as its
+        // turn for a code table has passed
+        if (job.reference != 0) {
+            size_t source = blockIndex.size() - static_cast<size_t>(job.reference);
+            if (blockIndex[source].rawSize == job.size && checksums[source] == job.encoded.checksum) {
+                stats.dedupBlocks++;
+            } else {
+                job.encoded.bytes.clear();
+                appendStoredBlock(job.encoded.bytes, job.data, job.size);
+                job.encoded.tableSize = 1;
+            }
+        }
+        const EncodedBlock& block = job.encoded;
+        StatsClock::time_point writeStart = StatsClock::now();
+        if (!output.write(reinterpret_cast<const char*>(block.bytes.data()), block.bytes.size())) {
+            throw std::runtime_error("Unable to write output file: " + outputPath);
+        }
+        stats.write += lapSeconds(writeStart);
+        stats.encoder += block.times;
+        if (options.verbose) {
+            for (int ch = 0; ch < 256; ++ch) {
+                summary.frequencies[ch] += block.frequencies[ch];
+            }
+        }
+        blockIndex.push_back({compressedOffset, static_cast<uint32_t>(block.bytes.size()), rawOffset, block.rawSize});
+        compressedOffset += block.bytes.size();
+        rawOffset += block.rawSize;
+        checksum = crc32cCombine(checksum, block.checksum, block.rawSize);
+        checksums.push_back(block.checksum);
+        stats.reusedTables += block.reusedTable ? 1 : 0;
+        stats.tansBlocks += block.tans ? 1 : 0;
+        summary.headerSize += BLOCK_HEADER_SIZE + block.tableSize;
+    };
+
+    // A failing stage leaves later blocks without their turn; coders waiting
+    // for one must fail too rather than wait forever
+    auto abortOnFailure = [&recentTables](auto stage) {
+        return [&recentTables, stage](PipelineBlock& job) {
+            try {
+                return stage(job);
+            } catch (...) {
+                recentTables.abort(std::current_exception());
+                throw;
+            }
+        };
+    };
+    stats.stalls = runBlockPipeline<PipelineBlock>(coders, abortOnFailure(readBlock), abortOnFailure(codeBlock),
+                                                   abortOnFailure(writeBlock));
+    stats.wait = stats.stalls.writerWait;
+
+    StatsClock::time_point phaseStart = StatsClock::now();
+    std::vector<uint8_t> footer;
+    appendFooter(footer, blockIndex, compressedOffset, checksum);
+    if (!output.write(reinterpret_cast<const char*>(footer.data()), footer.size()) || !output.flush()) {
+        throw std::runtime_error("Unable to write output file: " + outputPath);
+    }
+    stats.flush = lapSeconds(phaseStart);
+    summary.headerSize += footer.size();
+
+    stats.bytesIn = rawOffset;
+    stats.bytesOut = compressedOffset + footer.size();
+    stats.blocks = blockIndex.size();
+    stats.threads = coders;
+}
+
+void HuffmanEncoder::printSummary(std::ostream& out, const FrequencyTotals& frequencies, const RunStats& stats,
+                                  uint64_t headerSize) {
+    out << "Character frequency statistics:\n";
+    for (int charKey = 0; charKey < 256; ++charKey) {
+        uint64_t freq = frequencies[charKey];
+        if (freq == 0) {
+            continue;
+        }
+        if (std::isprint(charKey)) {
+            out << " '" << static_cast<char>(charKey) << "': " << freq << "\n";
+        } else {
+            out << " '\\x" << std::hex << charKey << std::dec << "': " << freq << "\n";
+        }
+    }
+
+    // Calculate and print compression ratio and header size
+    double compressionRatio = stats.bytesIn == 0 ? 0.0 :
+        (static_cast<double>(stats.bytesOut) / static_cast<double>(stats.bytesIn)) * 100.0;
+
+    std::ios::fmtflags flags = out.flags();
+    out << "\nInput file size: " << stats.bytesIn << " bytes\n";
+    out << "Blocks: " << stats.blocks << " (" << stats.threads << " threads)\n";
+    out << "Header size: " << headerSize << " bytes\n";
+    out << "Compressed file size: " << stats.bytesOut << " bytes\n";
+    out << "Compression ratio: " << std::fixed << std::setprecision(2) << compressionRatio << "%\n";
+    out.flags(flags);
+}
+
+size_t HuffmanEncoder::compressBound(size_t srcSize, uint32_t blockSize) {
+    size_t fullBlocks = srcSize / blockSize;
+    size_t tail = srcSize % blockSize;
+    size_t blockCount = fullBlocks + (tail > 0 ? 1 : 0);
+    size_t bound = FILE_HEADER_SIZE + 4 + blockCount * (BLOCK_HEADER_SIZE + MAX_INDEX_ENTRY_SIZE) + TRAILER_SIZE;
+    bound += fullBlocks * maxPayloadSize(blockSize);
+    if (tail > 0) {
+        bound += maxPayloadSize(static_cast<uint32_t>(tail));
+    }
+    return bound;
+}
+
+size_t HuffmanEncoder::compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity) {
+    compress(src, srcSize, buffer);
+    if (buffer.size() > dstCapacity) {
+        throw std::length_error("Output buffer too small: " + std::to_string(buffer.size()) + " bytes needed");
+    }
+    std::memcpy(dst, buffer.data(), buffer.size());
+    return buffer.size();
+}
+
+void HuffmanEncoder::compress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst) {
+    dst.clear();
+    bufferIndex.clear();
+    phaseTimes = EncoderPhaseTimes();
+    appendFileHeader(dst);
+    unsigned blockThreads = ThreadPool::resolveThreadCount(options.threads);
+    uint32_t checksum = 0;
+
+    // The whole input is at hand, so repeats found by fingerprint are
+    // confirmed by comparing the bytes
+    const uint64_t window = dedupWindow(options.blockSize);
+    std::unordered_map<uint64_t, size_t> fingerprints;
+    std::vector<uint32_t> checksums;
+    RecentTables recentTables;
+    for (size_t pos = 0; pos < srcSize; pos += options.blockSize) {
+        size_t size = std::min<size_t>(options.blockSize, srcSize - pos);
+        size_t blockNumber = bufferIndex.size();
+        uint64_t blockOffset = dst.size();
+        uint64_t distance = 0;
+        if (options.dedup && size >= DEDUP_MIN_BLOCK_SIZE) {
+            auto found = fingerprints.emplace(hash64(src + pos, size), blockNumber).first;
+            if (found->second != blockNumber) {
+                const BlockIndexEntry& source = bufferIndex[found->second];
+                if (blockNumber - found->second <= window && source.rawSize == size &&
+                    std::memcmp(src + source.rawOffset, src + pos, size) == 0) {
+                    distance = blockNumber - found->second;
+                } else {
+                    found->second = blockNumber;
+                }
+            }
+        }
+        uint32_t blockChecksum;
+        if (distance != 0) {
+            blockChecksum = checksums[blockNumber - distance];
+            appendReferenceBlock(dst, size, distance, blockChecksum);
+            recentTables.tablesFor(blockNumber);
+            recentTables.publish(blockNumber, nullptr);
+        } else {
+            appendBlock(dst, src + pos, size, scratch, phaseTimes, recentTables, blockNumber, blockThreads);
+            blockChecksum = scratch.checksum;
+        }
+        if (options.dedup) {
+            checksums.push_back(blockChecksum);
+        }
+        checksum = crc32cCombine(checksum, blockChecksum, size);
+        bufferIndex.push_back({blockOffset, static_cast<uint32_t>(dst.size() - blockOffset), pos,
+                               static_cast<uint32_t>(size)});
+    }
+    appendFooter(dst, bufferIndex, dst.size(), checksum);
+}
+
+void HuffmanEncoder::encodeBlock(EncodedBlock& block, BlockScratch& blockScratch, const ORIGINAL_DATA_TYPE* data,
+                                 size_t size, RecentTables& recentTables, uint64_t number,
+                                 unsigned threads) const {
+    block.bytes.clear();
+    block.rawSize = static_cast<uint32_t>(size);
+    block.times = EncoderPhaseTimes();
+    block.tableSize = appendBlock(block.bytes, data, size, blockScratch, block.times, recentTables, number, threads);
+    block.checksum = blockScratch.checksum;
+    block.reusedTable = blockScratch.reusedTable;
+    block.tans = blockScratch.tans;
+    block.frequencies = blockScratch.frequencies;
+}
+
+void HuffmanEncoder::encodeReference(EncodedBlock& block, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                     uint64_t distance) const {
+    StatsClock::time_point phaseStart = StatsClock::now();
+    block.bytes.clear();
+    block.rawSize = static_cast<uint32_t>(size);
+    block.times = EncoderPhaseTimes();
+    block.reusedTable = false;
+    block.tans = false;
+    // Only the --verbose summary needs the symbol counts of a repeat
+    if (options.verbose) {
+        countFrequencies(data, size, block.frequencies);
+        block.times.histogram += lapSeconds(phaseStart);
+    }
+    block.checksum = crc32c(data, size);
+    block.times.checksum += lapSeconds(phaseStart);
+    appendReferenceBlock(block.bytes, size, distance, block.checksum);
+    block.tableSize = block.bytes.size() - BLOCK_HEADER_SIZE;
+}
+
+size_t HuffmanEncoder::appendBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                   BlockScratch& blockScratch, EncoderPhaseTimes& times, RecentTables& recentTables,
+                                   uint64_t number, unsigned threads) const {
+    StatsClock::time_point phaseStart = StatsClock::now();
+
+    // Count character frequencies
+    FrequencyTable& frequencies = blockScratch.frequencies;
+    countFrequencies(data, size, frequencies, threads);
+    times.histogram += lapSeconds(phaseStart);
+
+    // Runs of one byte value and data that does not compress skip the coder.
+    // The checksum of a run needs no pass over the data, and stored blocks
+    // are checksummed as they are copied. Neither leaves a table for later
+    // blocks.
+    size_t blockStart = out.size();
+    blockScratch.reusedTable = false;
+    blockScratch.tans = false;
+    uint64_t entropy = 0;
+    uint8_t blockMode = chooseBlockMode(frequencies, size, options.table.get(), entropy);
+    if (blockMode == BLOCK_MODE_RLE || blockMode == BLOCK_MODE_STORED) {
+        recentTables.tablesFor(number);
+        recentTables.publish(number, nullptr);
+        if (blockMode == BLOCK_MODE_RLE) {
+            blockScratch.checksum = crc32cRun(data[0], size);
+            appendRleBlock(out, data[0], size, blockScratch.checksum);
+        } else {
+            blockScratch.checksum = appendStoredBlock(out, data, size);
+        }
+        times.encode += lapSeconds(phaseStart);
+        return 1;
+    }
+
+    // Checksum the block while it is still in cache from the count
+    uint32_t checksum = crc32c(data, size);
+    blockScratch.checksum = checksum;
+    times.checksum += lapSeconds(phaseStart);
+
+    // Pick the code table: the shared one, a recent one, or one built for
+    // this block. The coded size is exact once the table is known, so a block
+    // that would grow is stored, and the choice is published before the data
+    // is coded for the next block to make its own meanwhile.
+    bool fourStreams = options.streams == STREAM_COUNT && size >= MIN_MULTI_STREAM_BLOCK_SIZE;
+    bool shared = (blockMode & BLOCK_MODE_SHARED_TABLE) != 0;
+    RecentTables::Tables recent = recentTables.tablesFor(number);
+    const RecentTable* reused =
+        shared ? nullptr : chooseRecentTable(frequencies, size, entropy, number, recent, fourStreams);
+    HuffmanTree& tree = blockScratch.tree;
+    const CodeTable* codeTable;
+    size_t tableSize;
+    if (shared) {
+        codeTable = &options.table->codeTable();
+        tableSize = 0;
+    } else if (reused) {
+        codeTable = &reused->codeTable;
+        tableSize = varintSize(number - reused->block);
+    } else {
+        tree.buildTree(frequencies);
+        tree.generateCodeTable(options.maxCodeLength);
+        codeTable = &tree.codeTable;
+        size_t symbolCount = 0;
+        for (uint8_t length : tree.codeLengths) {
+            symbolCount += length > 0;
+        }
+        tableSize = codeLengthsSize(symbolCount);
+    }
+    uint64_t bits = codedBits(frequencies, *codeTable);
+    uint64_t huffmanPayload = huffmanPayloadBound(bits, tableSize, fourStreams);
+
+    // Skewed statistics leave whole-bit codes well above the entropy, and
+    // tANS then codes the block instead. Its counts are not a code table
+    // later blocks could reuse. The shared table only gives way when tANS is
+    // forced, as its blocks carry no table at all.
+    int tableLog = 0;
+    if ((!shared || options.coder == EntropyCoder::Tans) &&
+        chooseTans(frequencies, size, entropy, bits, huffmanPayload, blockScratch, tableLog)) {
+        recentTables.publish(number, nullptr);
+        times.tree += lapSeconds(phaseStart);
+        appendTansBlock(out, data, size, checksum, blockScratch, tableLog);
+        if (out.size() - blockStart - BLOCK_HEADER_SIZE > maxPayloadSize(static_cast<uint32_t>(size))) {
+            out.resize(blockStart);
+            blockScratch.checksum = appendStoredBlock(out, data, size);
+            times.encode += lapSeconds(phaseStart);
+            return 1;
+        }
+        blockScratch.tans = true;
+        times.encode += lapSeconds(phaseStart);
+        return 1 + normalizedCountsSize(blockScratch.tansCounts);
+    }
+    if (huffmanPayload > maxPayloadSize(static_cast<uint32_t>(size))) {
+        recentTables.publish(number, nullptr);
+        blockScratch.checksum = appendStoredBlock(out, data, size);
+        times.encode += lapSeconds(phaseStart);
+        return 1;
+    }
+    std::shared_ptr<RecentTable> built;
+    if (!shared && !reused) {
+        built = std::make_shared<RecentTable>();
+        built->block = number;
+        built->codeLengths = tree.codeLengths;
+        built->codeTable = tree.codeTable;
+        double excess = static_cast<double>(bits) - 8.0 * static_cast<double>(entropy);
+        built->excessBits = std::max(0.0, excess / static_cast<double>(size));
+    }
+    recentTables.publish(number, std::move(built));
+    blockScratch.reusedTable = reused != nullptr;
+    times.tree += lapSeconds(phaseStart);
+
+    // Block header; the payload size is filled in once it is known
+    appendUint32(out, static_cast<uint32_t>(size));
+    appendUint32(out, 0);
+    appendUint32(out, checksum);
+    out.push_back(static_cast<uint8_t>((fourStreams ? BLOCK_MODE_FOUR_STREAMS : BLOCK_MODE_SINGLE_STREAM) |
+                                       (shared ? BLOCK_MODE_SHARED_TABLE : 0) |
+                                       (reused ? BLOCK_MODE_RECENT_TABLE : 0)));
+
+    // Write the code lengths, from which the decoder rebuilds the canonical
+    // codes, or the distance to the block that has them
+    if (reused) {
+        appendVarint(out, number - reused->block);
+    } else if (!shared) {
+        writeCodeLengths(out, tree.codeLengths);
+    }
+    tableSize = out.size() - blockStart - BLOCK_HEADER_SIZE;
+    times.header += lapSeconds(phaseStart);
+
+    // Encode the data; the decoder stops after raw size symbols, so the
+    // padding in the last byte needs no marker
+    const PairCodeTable* pairCodes = pairCodesFor(*codeTable, size, blockScratch);
+    if (fourStreams) {
+        writeFourStreams(out, data, size, *codeTable, pairCodes, blockScratch);
+    } else if (threads > 1 && size >= PARALLEL_ENCODE_MIN_SIZE) {
+        writeStreamParallel(out, data, size, *codeTable, pairCodes, threads);
+    } else {
+        writeSingleStream(out, data, size, *codeTable, pairCodes);
+    }
+    storeUint32(&out[blockStart + 4], static_cast<uint32_t>(out.size() - blockStart - BLOCK_HEADER_SIZE));
+    times.encode += lapSeconds(phaseStart);
+    return tableSize;
+}
+
+uint8_t HuffmanEncoder::chooseBlockMode(const FrequencyTable& frequencies, size_t size, const SharedTable* table,
+                                        uint64_t& entropy) {
+    size_t symbolCount = 0;
+    uint64_t sharedBits = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (frequencies[ch] > 0) {
+            symbolCount++;
+            if (table) {
+                sharedBits += static_cast<uint64_t>(frequencies[ch]) * table->codeTable()[ch].length;
+            }
+        }
+    }
+    if (symbolCount == 1) {
+        return BLOCK_MODE_RLE;
+    }
+    size_t worthwhileSize = size - size / STORED_BLOCK_DIVISOR;
+
+    // Small blocks use the shared table without estimating their own
+    uint64_t sharedBytes = (sharedBits + 7) / 8;
+    if (table && size < OWN_TABLE_MIN_SIZE) {
+        return sharedBytes < worthwhileSize ? BLOCK_MODE_SINGLE_STREAM | BLOCK_MODE_SHARED_TABLE : BLOCK_MODE_STORED;
+    }
+
+    entropy = entropyBytes(frequencies);
+    uint64_t ownBytes = entropy + codeLengthsSize(symbolCount);
+    if (table && sharedBytes <= ownBytes) {
+        return sharedBytes < worthwhileSize ? BLOCK_MODE_SINGLE_STREAM | BLOCK_MODE_SHARED_TABLE : BLOCK_MODE_STORED;
+    }
+    if (ownBytes >= worthwhileSize) {
+        return BLOCK_MODE_STORED;
+    }
+    return BLOCK_MODE_SINGLE_STREAM;
+}
+
+const RecentTable* HuffmanEncoder::chooseRecentTable(const FrequencyTable& frequencies, size_t size, uint64_t entropy,
+                                                     uint64_t number, const RecentTables::Tables& tables,
+                                                     bool fourStreams) {
+    if (tables.empty()) {
+        return nullptr;
+    }
+    size_t symbolCount = 0;
+    for (uint32_t count : frequencies) {
+        symbolCount += count > 0;
+    }
+    double entropyBits = 8.0 * static_cast<double>(entropy);
+    double tableBits = 8.0 * static_cast<double>(codeLengthsSize(symbolCount));
+
+    // A table built for this block would likely sit as far above the entropy
+    // as the candidate did on its own block, plus the code lengths
+    const RecentTable* best = nullptr;
+    uint64_t bestBits = UINT64_MAX;
+    for (const std::shared_ptr<const RecentTable>& table : tables) {
+        uint64_t bits = codedBits(frequencies, table->codeTable);
+        if (bits == UINT64_MAX) {
+            continue;
+        }
+        size_t distanceSize = varintSize(number - table->block);
+        double ownBits = entropyBits + table->excessBits * static_cast<double>(size) + tableBits;
+        uint64_t reuseBits = bits + 8 * distanceSize;
+        if (reuseBits < bestBits && reuseBits <= ownBits + ownBits / TABLE_REUSE_DIVISOR &&
+            huffmanPayloadBound(bits, distanceSize, fourStreams) <= maxPayloadSize(static_cast<uint32_t>(size))) {
+            best = table.get();
+            bestBits = reuseBits;
+        }
+    }
+    return best;
+}
+
+uint64_t HuffmanEncoder::codedBits(const FrequencyTable& frequencies, const CodeTable& codeTable) {
+    uint64_t bits = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (frequencies[ch] > 0) {
+            if (codeTable[ch].length == 0) {
+                return UINT64_MAX;
+            }
+            bits += static_cast<uint64_t>(frequencies[ch]) * codeTable[ch].length;
+        }
+    }
+    return bits;
+}
+
+bool HuffmanEncoder::chooseTans(const FrequencyTable& frequencies, size_t size, uint64_t entropy, uint64_t bits,
+                                uint64_t huffmanPayload, BlockScratch& blockScratch, int& tableLog) const {
+    if (options.coder == EntropyCoder::Huffman) {
+        return false;
+    }
+    bool forced = options.coder == EntropyCoder::Tans;
+    // tANS gets close to the entropy but not below it, so the Huffman codes
+    // must be well above it before the counts are worth normalizing
+    if (!forced && bits <= 8 * entropy + 8 * huffmanPayload / TANS_MIN_GAIN_DIVISOR) {
+        return false;
+    }
+    size_t symbolCount = 0;
+    for (uint32_t count : frequencies) {
+        symbolCount += count > 0;
+    }
+    tableLog = tansTableLog(size, symbolCount);
+    NormalizedCounts& counts = blockScratch.tansCounts;
+    normalizeCounts(frequencies, size, tableLog, counts);
+    if (forced) {
+        return true;
+    }
+    uint64_t tansPayload = 1 + normalizedCountsSize(counts) + (tansCodedBits(frequencies, counts, tableLog) + 7) / 8;
+    return tansPayload + huffmanPayload / TANS_MIN_GAIN_DIVISOR < huffmanPayload;
+}
+
+uint64_t HuffmanEncoder::huffmanPayloadBound(uint64_t bits, size_t tableSize, bool fourStreams) {
+    // Each of the four streams pads to a byte on its own
+    uint64_t dataSize = (bits + 7) / 8;
+    if (fourStreams) {
+        dataSize += STREAM_JUMP_TABLE_SIZE + STREAM_COUNT - 1;
+    }
+    return 1 + tableSize + dataSize;
+}
+
+uint32_t HuffmanEncoder::appendStoredBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size) {
+    size_t blockStart = out.size();
+    appendUint32(out, static_cast<uint32_t>(size));
+    appendUint32(out, static_cast<uint32_t>(1 + size));
+    appendUint32(out, 0);
+    out.push_back(BLOCK_MODE_STORED);
+    out.resize(out.size() + size);
+    uint32_t checksum = crc32cCopy(&out[out.size() - size], data, size);
+    storeUint32(&out[blockStart + 8], checksum);
+    return checksum;
+}
+
+void HuffmanEncoder::appendTansBlock(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                     uint32_t checksum, BlockScratch& blockScratch, int tableLog) {
+    size_t blockStart = out.size();
+    appendUint32(out, static_cast<uint32_t>(size));
+    appendUint32(out, 0);
+    appendUint32(out, checksum);
+    out.push_back(BLOCK_MODE_TANS);
+    writeNormalizedCounts(out, blockScratch.tansCounts, tableLog);
+    blockScratch.tansTable.build(blockScratch.tansCounts, tableLog);
+    blockScratch.tansTable.encode(out, data, size);
+    storeUint32(&out[blockStart + 4], static_cast<uint32_t>(out.size() - blockStart - BLOCK_HEADER_SIZE));
+}
+
+void HuffmanEncoder::appendRleBlock(std::vector<uint8_t>& out, ORIGINAL_DATA_TYPE symbol, size_t size,
+                                    uint32_t checksum) {
+    appendUint32(out, static_cast<uint32_t>(size));
+    appendUint32(out, 2);
+    appendUint32(out, checksum);
+    out.push_back(BLOCK_MODE_RLE);
+    out.push_back(symbol);
+}
+
+void HuffmanEncoder::appendReferenceBlock(std::vector<uint8_t>& out, size_t size, uint64_t distance,
+                                          uint32_t checksum) {
+    size_t blockStart = out.size();
+    appendUint32(out, static_cast<uint32_t>(size));
+    appendUint32(out, 0);
+    appendUint32(out, checksum);
+    out.push_back(BLOCK_MODE_REFERENCE);
+    appendVarint(out, distance);
+    storeUint32(&out[blockStart + 4], static_cast<uint32_t>(out.size() - blockStart - BLOCK_HEADER_SIZE));
+}
+
+const PairCodeTable* HuffmanEncoder::pairCodesFor(const CodeTable& codeTable, size_t size,
+                                                  BlockScratch& blockScratch) {
+    std::array<ORIGINAL_DATA_TYPE, 256> symbols;
+    size_t symbolCount = 0;
+    bool same = !blockScratch.pairCodes.empty();
+    for (int ch = 0; ch < 256; ++ch) {
+        const HuffmanCode& code = codeTable[ch];
+        if (code.length > 0) {
+            symbols[symbolCount++] = static_cast<ORIGINAL_DATA_TYPE>(ch);
+        }
+        same = same && code.length == blockScratch.pairSource[ch].length &&
+               code.code == blockScratch.pairSource[ch].code;
+    }
+    if (same) {
+        return &blockScratch.pairCodes;
+    }
+    // Each pair costs about as much to fill as a symbol to code
+    if (symbolCount * symbolCount > size / 2) {
+        return nullptr;
+    }
+
+    PairCodeTable& pairCodes = blockScratch.pairCodes;
+    pairCodes.resize(PAIR_TABLE_SIZE);
+    for (size_t f = 0; f < symbolCount; ++f) {
+        const HuffmanCode& firstCode = codeTable[symbols[f]];
+        PairCode* row = &pairCodes[static_cast<size_t>(symbols[f]) << 8];
+        for (size_t s = 0; s < symbolCount; ++s) {
+            ORIGINAL_DATA_TYPE second = symbols[s];
+            const HuffmanCode& secondCode = codeTable[second];
+            row[second].code = (firstCode.code << secondCode.length) | secondCode.code;
+            row[second].length = static_cast<uint32_t>(firstCode.length + secondCode.length);
+        }
+    }
+    blockScratch.pairSource = codeTable;
+    return &pairCodes;
+}
+
+void HuffmanEncoder::writeSingleStream(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                       const CodeTable& codeTable, const PairCodeTable* pairCodes) {
+    BitWriter bitWriter(out);
+    size_t i = 0;
+    if (pairCodes) {
+        for (; i + 1 < size; i += 2) {
+            const PairCode& pair = (*pairCodes)[(data[i] << 8) | data[i + 1]];
+            bitWriter.writeBits(pair.code, static_cast<int>(pair.length));
+        }
+    }
+    for (; i < size; ++i) {
+        const HuffmanCode& code = codeTable[data[i]];
+        bitWriter.writeBits(code.code, code.length);
+    }
+    bitWriter.flush();
+}
+
+void HuffmanEncoder::writeStreamParallel(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                         const CodeTable& codeTable, const PairCodeTable* pairCodes,
+                                         unsigned threads) {
+    // One chunk per thread, each at least half the parallel threshold; the
+    // calling thread takes the first one
+    size_t chunkCount = std::min<size_t>(threads, size / (PARALLEL_ENCODE_MIN_SIZE / 2));
+    size_t chunkSize = (size + chunkCount - 1) / chunkCount;
+    std::vector<uint64_t> bitOffsets(chunkCount + 1, 0);
+    std::vector<ChunkTail> tails(chunkCount);
+    std::vector<std::thread> workers;
+
+    // Coded length of every chunk from its histogram; the exclusive prefix
+    // sum gives the bit offset each chunk starts at
+    auto measureChunk = [&](size_t c) {
+        size_t begin = c * chunkSize;
+        FrequencyTable chunkFrequencies;
+        countFrequencies(data + begin, std::min(chunkSize, size - begin), chunkFrequencies);
+        uint64_t bits = 0;
+        for (int ch = 0; ch < 256; ++ch) {
+            bits += static_cast<uint64_t>(chunkFrequencies[ch]) * codeTable[ch].length;
+        }
+        bitOffsets[c + 1] = bits;
+    };
+    for (size_t c = 1; c < chunkCount; ++c) {
+        workers.emplace_back(measureChunk, c);
+    }
+    measureChunk(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    for (size_t c = 0; c < chunkCount; ++c) {
+        bitOffsets[c + 1] += bitOffsets[c];
+    }
+
+    // Every chunk writes its own bit range; out is zero-filled, so the final
+    // padding bits need no extra work
+    size_t start = out.size();
+    out.resize(start + static_cast<size_t>((bitOffsets[chunkCount] + 7) / 8));
+    uint8_t* streamStart = out.data() + start;
+    auto encodeChunkAt = [&](size_t c) {
+        size_t begin = c * chunkSize;
+        tails[c] = encodeChunk(streamStart, bitOffsets[c], data + begin, std::min(chunkSize, size - begin),
+                               codeTable, pairCodes);
+    };
+    for (size_t c = 1; c < chunkCount; ++c) {
+        workers.emplace_back(encodeChunkAt, c);
+    }
+    encodeChunkAt(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // Merge the bytes shared by neighbouring chunks
+    for (const ChunkTail& tail : tails) {
+        if (tail.bits != 0) {
+            streamStart[tail.index] |= tail.bits;
+        }
+    }
+}
+
+void HuffmanEncoder::writeFourStreams(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size,
+                                      const CodeTable& codeTable, const PairCodeTable* pairCodes,
+                                      BlockScratch& blockScratch) {
+    // Segments of ceil(size / 4) bytes; the last one takes what is left
+    size_t segment = (size + STREAM_COUNT - 1) / STREAM_COUNT;
+    size_t lastSegment = size - segment * (STREAM_COUNT - 1);
+    const ORIGINAL_DATA_TYPE* in0 = data;
+    const ORIGINAL_DATA_TYPE* in1 = data + segment;
+    const ORIGINAL_DATA_TYPE* in2 = data + 2 * segment;
+    const ORIGINAL_DATA_TYPE* in3 = data + 3 * segment;
+    for (std::vector<uint8_t>& stream : blockScratch.streams) {
+        stream.clear();
+    }
+    BitWriter writer0(blockScratch.streams[0]);
+    BitWriter writer1(blockScratch.streams[1]);
+    BitWriter writer2(blockScratch.streams[2]);
+    BitWriter writer3(blockScratch.streams[3]);
+
+    // All four streams in lockstep, two symbols a step while the pair codes
+    // last, then the rest of the longer first three
+    size_t i = 0;
+    if (pairCodes) {
+        const PairCodeTable& pairs = *pairCodes;
+        for (; i + 1 < lastSegment; i += 2) {
+            const PairCode& pair0 = pairs[(in0[i] << 8) | in0[i + 1]];
+            const PairCode& pair1 = pairs[(in1[i] << 8) | in1[i + 1]];
+            const PairCode& pair2 = pairs[(in2[i] << 8) | in2[i + 1]];
+            const PairCode& pair3 = pairs[(in3[i] << 8) | in3[i + 1]];
+            writer0.writeBits(pair0.code, static_cast<int>(pair0.length));
+            writer1.writeBits(pair1.code, static_cast<int>(pair1.length));
+            writer2.writeBits(pair2.code, static_cast<int>(pair2.length));
+            writer3.writeBits(pair3.code, static_cast<int>(pair3.length));
+        }
+    }
+    for (; i < lastSegment; ++i) {
+        const HuffmanCode& code0 = codeTable[in0[i]];
+        const HuffmanCode& code1 = codeTable[in1[i]];
+        const HuffmanCode& code2 = codeTable[in2[i]];
+        const HuffmanCode& code3 = codeTable[in3[i]];
+        writer0.writeBits(code0.code, code0.length);
+        writer1.writeBits(code1.code, code1.length);
+        writer2.writeBits(code2.code, code2.length);
+        writer3.writeBits(code3.code, code3.length);
+    }
+    for (; i < segment; ++i) {
+        const HuffmanCode& code0 = codeTable[in0[i]];
+        const HuffmanCode& code1 = codeTable[in1[i]];
+        const HuffmanCode& code2 = codeTable[in2[i]];
+        writer0.writeBits(code0.code, code0.length);
+        writer1.writeBits(code1.code, code1.length);
+        writer2.writeBits(code2.code, code2.length);
+    }
+    writer0.flush();
+    writer1.flush();
+    writer2.flush();
+    writer3.flush();
+
+    // Jump table, then the streams back to back
+    for (int s = 0; s < STREAM_COUNT - 1; ++s) {
+        appendUint32(out, static_cast<uint32_t>(blockScratch.streams[s].size()));
+    }
+    for (const std::vector<uint8_t>& stream : blockScratch.streams) {
+        out.insert(out.end(), stream.begin(), stream.end());
+    }
+}
+
+void HuffmanEncoder::appendFileHeader(std::vector<uint8_t>& out) const {
+    // Magic bytes, format version, flags, block size and shared table ID
+    size_t start = out.size();
+    out.resize(start + FILE_HEADER_SIZE);
+    std::memcpy(&out[start], FORMAT_MAGIC, sizeof(FORMAT_MAGIC));
+    out[start + sizeof(FORMAT_MAGIC)] = FORMAT_VERSION;
+    out[start + sizeof(FORMAT_MAGIC) + 1] = options.dedup ? FILE_FLAG_DEDUP : 0;
+    storeUint32(&out[start + sizeof(FORMAT_MAGIC) + 2], options.blockSize);
+    storeUint32(&out[start + sizeof(FORMAT_MAGIC) + 2 + 4], options.table ? options.table->id() : 0);
+}
+
+void HuffmanEncoder::appendFooter(std::vector<uint8_t>& out, const std::vector<BlockIndexEntry>& blockIndex,
+                                  uint64_t compressedOffset, uint32_t checksum) {
+    // End marker (a block with raw size 0), block index and trailer
+    appendUint32(out, 0);
+    uint64_t indexOffset = compressedOffset + 4;
+    for (const BlockIndexEntry& entry : blockIndex) {
+        appendVarint(out, entry.compressedSize);
+        appendVarint(out, entry.rawSize);
+    }
+    appendUint64(out, blockIndex.size());
+    appendUint64(out, indexOffset);
+    appendUint32(out, checksum);
+    out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+}
+
+HuffmanEncoder::HuffmanEncoder(const EncoderOptions& options) : options(options) {
+    if (options.maxCodeLength < MIN_CODE_LENGTH_LIMIT || options.maxCodeLength > MAX_CODE_LENGTH_LIMIT) {
+        throw std::invalid_argument("Maximum code length must be between " + std::to_string(MIN_CODE_LENGTH_LIMIT) +
+                                    " and " + std::to_string(MAX_CODE_LENGTH_LIMIT));
+    }
+    if (options.streams != 1 && options.streams != STREAM_COUNT) {
+        throw std::invalid_argument("Stream count must be 1 or " + std::to_string(STREAM_COUNT));
+    }
+    if (options.blockSize == 0 || options.blockSize > MAX_BLOCK_SIZE) {
+        throw std::invalid_argument("Block size must be between 1 and " + std::to_string(MAX_BLOCK_SIZE) + " bytes");
+    }
+}
+
+void HuffmanEncoder::writeCodeLengths(std::vector<uint8_t>& out, const CodeLengthTable& codeLengths) {
+    std::vector<uint8_t> symbols;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (codeLengths[ch] > 0) {
+            symbols.push_back(static_cast<uint8_t>(ch));
+        }
+    }
+
+    // Number of symbols that occur, minus one (1 byte)
+    out.push_back(static_cast<uint8_t>(symbols.size() - 1));
+
+    // The symbols themselves: listed one per byte when there are only a few,
+    // otherwise as a 32-byte presence bitmap
+    if (symbols.size() < SYMBOL_BITMAP_SIZE) {
+        out.insert(out.end(), symbols.begin(), symbols.end());
+    } else {
+        uint8_t presence[SYMBOL_BITMAP_SIZE] = {0};
+        for (uint8_t ch : symbols) {
+            presence[ch / 8] |= static_cast<uint8_t>(0x80 >> (ch % 8));
+        }
+        out.insert(out.end(), presence, presence + sizeof(presence));
+    }
+
+    // Code lengths of the present symbols, two 4-bit lengths per byte
+    std::vector<uint8_t> packed((symbols.size() + 1) / 2, 0);
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        packed[i / 2] |= static_cast<uint8_t>(codeLengths[symbols[i]] << (i % 2 == 0 ? 4 : 0));
+    }
+    out.insert(out.end(), packed.begin(), packed.end());
+}
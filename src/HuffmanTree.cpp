@@ -1,111 +1,150 @@
-// src/HuffmanTree.cpp
-#include "HuffmanTree.h"
-#include <queue>
-#include <stdexcept>
-
-// VectorBoolHash implementation
-std::size_t VectorBoolHash::operator()(const std::vector<bool>& v) const {
-    std::size_t hash = 0;
-    for (bool bit : v) {
-        hash = (hash << 1) | bit;
-    }
-    return hash;
-}
-
-// HuffmanNode implementation
-HuffmanNode::HuffmanNode(ORIGINAL_DATA_TYPE ch, int freq)
-    : character(ch), frequency(freq), left(nullptr), right(nullptr) {}
-
-bool HuffmanNode::isLeaf() const {
-    return !left && !right;
-}
-
-// CompareNode implementation
-bool CompareNode::operator()(const std::shared_ptr<HuffmanNode>& a, const std::shared_ptr<HuffmanNode>& b) const {
-    return a->frequency > b->frequency;
-}
-
-// HuffmanTree implementation
-void HuffmanTree::buildTree(const std::unordered_map<ORIGINAL_DATA_TYPE, int>& frequencyMap) {
-    std::priority_queue<std::shared_ptr<HuffmanNode>, std::vector<std::shared_ptr<HuffmanNode>>, CompareNode> minHeap;
-
-    // Create leaf nodes and add them to the priority queue
-    for (const auto& [ch, freq] : frequencyMap) {
-        minHeap.emplace(std::make_shared<HuffmanNode>(ch, freq));
-    }
-
-    // Handle special case: only one unique character in the file
-    if (minHeap.size() == 1) {
-        auto onlyNode = minHeap.top();
-        minHeap.pop();
-        auto parent = std::make_shared<HuffmanNode>(0, onlyNode->frequency);
-        parent->left = onlyNode;
-        minHeap.emplace(parent);
-    }
-
-    // Build the Huffman tree
-    while (minHeap.size() > 1) {
-        auto left = minHeap.top();
-        minHeap.pop();
-        auto right = minHeap.top();
-        minHeap.pop();
-
-        auto parent = std::make_shared<HuffmanNode>(0, left->frequency + right->frequency);
-        parent->left = left;
-        parent->right = right;
-
-        minHeap.emplace(parent);
-    }
-
-    // Root node of the tree
-    if (!minHeap.empty()) {
-        root = minHeap.top();
-        minHeap.pop();
-    }
-}
-
-void HuffmanTree::buildTreeFromCodeTable(const std::unordered_map<std::vector<bool>, ORIGINAL_DATA_TYPE, VectorBoolHash>& inverseCodeTable) {
-    root = std::make_shared<HuffmanNode>(0, 0); // Create an empty root node
-
-    for (const auto& [code, ch] : inverseCodeTable) {
-        auto currentNode = root;
-        for (size_t i = 0; i < code.size(); ++i) {
-            bool bit = code[i];
-            if (bit) { // Right child node
-                if (!currentNode->right) {
-                    currentNode->right = std::make_shared<HuffmanNode>(0, 0);
-                }
-                currentNode = currentNode->right;
-            } else { // Left child node
-                if (!currentNode->left) {
-                    currentNode->left = std::make_shared<HuffmanNode>(0, 0);
-                }
-                currentNode = currentNode->left;
-            }
-        }
-        currentNode->character = ch; // Assign value to leaf node
-    }
-}
-
-void HuffmanTree::generateCodeTable() {
-    if (!root) return;
-    std::vector<bool> currentCode;
-    traverse(root, currentCode);
-}
-
-void HuffmanTree::traverse(const std::shared_ptr<HuffmanNode>& node, std::vector<bool>& currentCode) {
-    if (node->isLeaf()) {
-        codeTable[node->character] = currentCode;
-        return;
-    }
-    if (node->left) {
-        currentCode.push_back(false);
-        traverse(node->left, currentCode);
-        currentCode.pop_back();
-    }
-    if (node->right) {
-        currentCode.push_back(true);
-        traverse(node->right, currentCode);
-        currentCode.pop_back();
-    }
-}
+// src/HuffmanTree.cpp
+#include "HuffmanTree.h"
+#include "Format.h"
+#include <algorithm>
+#include <stdexcept>
+
+void HuffmanTree::buildTree(const FrequencyTable& frequencies) {
+    // Leaves of the symbols that occur, rarest first
+    leafCount = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (frequencies[ch] > 0) {
+            nodes[leafCount++] = {frequencies[ch], -1, -1, static_cast<ORIGINAL_DATA_TYPE>(ch)};
+        }
+    }
+    std::sort(nodes.begin(), nodes.begin() + leafCount, [](const HuffmanNode& a, const HuffmanNode& b) {
+        if (a.frequency != b.frequency) {
+            return a.frequency < b.frequency;
+        }
+        return a.character > b.character;
+    });
+    nodeCount = leafCount;
+    root = -1;
+    if (leafCount == 0) {
+        return;
+    }
+
+    // Handle special case: only one unique character in the file
+    if (leafCount == 1) {
+        nodes[nodeCount] = {nodes[0].frequency, 0, -1, 0};
+        root = nodeCount++;
+        return;
+    }
+
+    // Merged nodes are created in non-decreasing frequency order, so the two
+    // smallest nodes are always at the front of the leaves or of the merged
+    // nodes
+    int nextLeaf = 0;
+    int nextMerged = leafCount;
+    auto takeSmallest = [&]() {
+        if (nextLeaf < leafCount &&
+            (nextMerged == nodeCount || nodes[nextLeaf].frequency <= nodes[nextMerged].frequency)) {
+            return nextLeaf++;
+        }
+        return nextMerged++;
+    };
+    while (nodeCount < 2 * leafCount - 1) {
+        int left = takeSmallest();
+        int right = takeSmallest();
+        nodes[nodeCount] = {nodes[left].frequency + nodes[right].frequency,
+                            static_cast<int16_t>(left), static_cast<int16_t>(right), 0};
+        nodeCount++;
+    }
+    root = nodeCount - 1;
+}
+
+void HuffmanTree::generateCodeTable(int maxCodeLength) {
+    codeLengths.fill(0);
+    codeTable.fill({0, 0});
+    if (root < 0) return;
+
+    // Depths top-down: every parent comes after its children
+    std::array<int, MAX_NODES> depths;
+    depths[root] = 0;
+    for (int i = root; i >= leafCount; --i) {
+        depths[nodes[i].left] = depths[i] + 1;
+        if (nodes[i].right >= 0) {
+            depths[nodes[i].right] = depths[i] + 1;
+        }
+    }
+
+    // Count codes per length, folding everything deeper than the limit into it
+    std::array<int, MAX_CODE_LENGTH_LIMIT + 1> lengthCount{};
+    bool overLimit = false;
+    for (int i = 0; i < leafCount; ++i) {
+        if (depths[i] > maxCodeLength) {
+            overLimit = true;
+        }
+        lengthCount[std::min(depths[i], maxCodeLength)]++;
+    }
+
+    if (!overLimit) {
+        for (int i = 0; i < leafCount; ++i) {
+            codeLengths[nodes[i].character] = static_cast<uint8_t>(depths[i]);
+        }
+    } else {
+        // The clamped lengths violate the Kraft inequality. Take one code from
+        // the longest length, then split a shorter code into two codes one bit
+        // longer; each round lowers the Kraft sum by one unit of 2^-maxCodeLength.
+        uint32_t total = 0;
+        for (int len = 1; len <= maxCodeLength; ++len) {
+            total += static_cast<uint32_t>(lengthCount[len]) << (maxCodeLength - len);
+        }
+        while (total > (1u << maxCodeLength)) {
+            lengthCount[maxCodeLength]--;
+            for (int len = maxCodeLength - 1; len > 0; --len) {
+                if (lengthCount[len] > 0) {
+                    lengthCount[len]--;
+                    lengthCount[len + 1] += 2;
+                    break;
+                }
+            }
+            total--;
+        }
+
+        // Hand out the shortest lengths to the most frequent symbols; the
+        // leaves are sorted rarest first
+        int next = leafCount - 1;
+        for (int len = 1; len <= maxCodeLength; ++len) {
+            for (int i = 0; i < lengthCount[len]; ++i) {
+                codeLengths[nodes[next--].character] = static_cast<uint8_t>(len);
+            }
+        }
+    }
+
+    generateCodeTableFromLengths(codeLengths);
+}
+
+void HuffmanTree::generateCodeTableFromLengths(const CodeLengthTable& lengths) {
+    codeLengths = lengths;
+    codeTable.fill({0, 0});
+
+    // Canonical codes: ordered by length, then by symbol value
+    int maxLength = 0;
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 2> lengthCount{};
+    for (uint8_t len : lengths) {
+        if (len > MAX_CODE_LENGTH_LIMIT) {
+            throw std::runtime_error("Code length exceeds the supported maximum");
+        }
+        lengthCount[len]++;
+        maxLength = std::max<int>(maxLength, len);
+    }
+    lengthCount[0] = 0;
+
+    std::array<uint32_t, MAX_CODE_LENGTH_LIMIT + 2> nextCode{};
+    uint32_t code = 0;
+    for (int len = 1; len <= maxLength; ++len) {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    for (int ch = 0; ch < 256; ++ch) {
+        int len = lengths[ch];
+        if (len == 0) continue;
+        uint32_t value = nextCode[len]++;
+        if (value >> len) {
+            throw std::runtime_error("Invalid code lengths: over-subscribed code");
+        }
+        codeTable[ch] = {value, static_cast<uint8_t>(len)};
+    }
+}
@@ -0,0 +1,29 @@
+// src/MappedFile.cpp
+#include "MappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::unique_ptr<MappedFile> MappedFile::tryMap(int fd, uint64_t size, bool writable) {
+    struct stat st;
+    if (size == 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<uint64_t>(st.st_size) < size) {
+        return nullptr;
+    }
+
+    int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* address = ::mmap(nullptr, static_cast<size_t>(size), protection, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<uint8_t*>(address), size));
+}
+
+MappedFile::MappedFile(uint8_t* address, uint64_t length) : address(address), length(length) {}
+
+MappedFile::~MappedFile() {
+    ::munmap(address, static_cast<size_t>(length));
+}
+
+void MappedFile::adviseSequential() const {
+    // Only a hint; failure is harmless
+    ::madvise(address, static_cast<size_t>(length), MADV_SEQUENTIAL);
+}
@@ -0,0 +1,42 @@
+// src/RecentTables.cpp
+#include "RecentTables.h"
+#include "Format.h"
+
+RecentTables::Tables RecentTables::tablesFor(uint64_t number) {
+    std::unique_lock<std::mutex> lock(mutex);
+    publishedCondition.wait(lock, [this, number]() { return nextBlock == number || error; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    Tables usable;
+    for (const std::shared_ptr<const RecentTable>& table : tables) {
+        if (number - table->block <= RECENT_TABLE_WINDOW) {
+            usable.push_back(table);
+        }
+    }
+    return usable;
+}
+
+void RecentTables::publish(uint64_t number, std::shared_ptr<const RecentTable> table) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (table) {
+            tables.insert(tables.begin(), std::move(table));
+            if (tables.size() > RECENT_TABLE_COUNT) {
+                tables.pop_back();
+            }
+        }
+        nextBlock = number + 1;
+    }
+    publishedCondition.notify_all();
+}
+
+void RecentTables::abort(std::exception_ptr failure) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = failure;
+        }
+    }
+    publishedCondition.notify_all();
+}
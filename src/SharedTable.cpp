@@ -0,0 +1,129 @@
+// src/SharedTable.cpp
+#include "SharedTable.h"
+#include "Format.h"
+#include "Histogram.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void addFileFrequencies(const std::string& path, FrequencyTotals& totals) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("Unable to open sample file: " + path);
+    }
+    std::vector<ORIGINAL_DATA_TYPE> buffer(DEFAULT_BLOCK_SIZE);
+    FrequencyTable frequencies;
+    for (;;) {
+        input.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        size_t got = static_cast<size_t>(input.gcount());
+        if (got == 0) {
+            break;
+        }
+        countFrequencies(buffer.data(), got, frequencies);
+        for (int ch = 0; ch < 256; ++ch) {
+            totals[ch] += frequencies[ch];
+        }
+    }
+}
+
+} // namespace
+
+SharedTable::SharedTable(const CodeLengthTable& codeLengths) {
+    tree.generateCodeTableFromLengths(codeLengths);
+    decoder.build(codeLengths);
+
+    // FNV-1a over the code lengths; 0 means "no table" in file headers
+    uint32_t hash = 2166136261u;
+    for (uint8_t length : codeLengths) {
+        hash = (hash ^ length) * 16777619u;
+    }
+    tableId = hash == 0 ? 1 : hash;
+}
+
+SharedTable SharedTable::train(const std::vector<std::string>& samplePaths, int maxCodeLength) {
+    FrequencyTotals totals{};
+    for (const std::string& path : samplePaths) {
+        if (fs::is_directory(path)) {
+            for (const fs::directory_entry& entry : fs::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file()) {
+                    addFileFrequencies(entry.path().string(), totals);
+                }
+            }
+        } else {
+            addFileFrequencies(path, totals);
+        }
+    }
+    return fromFrequencies(totals, maxCodeLength);
+}
+
+SharedTable SharedTable::fromFrequencies(const FrequencyTotals& frequencies, int maxCodeLength) {
+    if (maxCodeLength < MIN_CODE_LENGTH_LIMIT || maxCodeLength > MAX_CODE_LENGTH_LIMIT) {
+        throw std::invalid_argument("Maximum code length must be between " + std::to_string(MIN_CODE_LENGTH_LIMIT) +
+                                    " and " + std::to_string(MAX_CODE_LENGTH_LIMIT));
+    }
+    // Scale the totals into 32 bits and count every symbol at least once,
+    // so that bytes missing from the samples can still be coded
+    uint64_t largest = *std::max_element(frequencies.begin(), frequencies.end());
+    int shift = 0;
+    while ((largest >> shift) >= (1u << 31)) {
+        shift++;
+    }
+    FrequencyTable scaled;
+    for (int ch = 0; ch < 256; ++ch) {
+        scaled[ch] = static_cast<uint32_t>(frequencies[ch] >> shift) + 1;
+    }
+    HuffmanTree trained;
+    trained.buildTree(scaled);
+    trained.generateCodeTable(maxCodeLength);
+    return SharedTable(trained.codeLengths);
+}
+
+SharedTable SharedTable::load(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("Unable to open table file: " + path);
+    }
+    uint8_t bytes[TABLE_FILE_SIZE];
+    if (!input.read(reinterpret_cast<char*>(bytes), sizeof(bytes)) ||
+        std::memcmp(bytes, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0) {
+        throw std::runtime_error("Not an HZip table file: " + path);
+    }
+    if (bytes[sizeof(TABLE_MAGIC)] != TABLE_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported table file version: " + std::to_string(bytes[sizeof(TABLE_MAGIC)]));
+    }
+
+    // Two 4-bit code lengths per byte, every symbol present
+    const uint8_t* packed = bytes + sizeof(TABLE_MAGIC) + 1 + 4;
+    CodeLengthTable codeLengths{};
+    for (int ch = 0; ch < 256; ++ch) {
+        codeLengths[ch] = static_cast<uint8_t>(ch % 2 == 0 ? packed[ch / 2] >> 4 : packed[ch / 2] & 0x0F);
+        if (codeLengths[ch] == 0) {
+            throw std::runtime_error("Corrupt table file: " + path);
+        }
+    }
+    SharedTable table(codeLengths);
+    if (table.id() != loadUint32(bytes + sizeof(TABLE_MAGIC) + 1)) {
+        throw std::runtime_error("Corrupt table file: " + path);
+    }
+    return table;
+}
+
+void SharedTable::save(const std::string& path) const {
+    std::vector<uint8_t> bytes(TABLE_MAGIC, TABLE_MAGIC + sizeof(TABLE_MAGIC));
+    bytes.push_back(TABLE_FORMAT_VERSION);
+    appendUint32(bytes, tableId);
+    for (int ch = 0; ch < 256; ch += 2) {
+        bytes.push_back(static_cast<uint8_t>(tree.codeLengths[ch] << 4 | tree.codeLengths[ch + 1]));
+    }
+    std::ofstream output(path, std::ios::binary);
+    if (!output.is_open() || !output.write(reinterpret_cast<const char*>(bytes.data()), bytes.size()) ||
+        !output.flush()) {
+        throw std::runtime_error("Unable to write table file: " + path);
+    }
+}
@@ -0,0 +1,75 @@
+// src/Stats.cpp
+#include "Stats.h"
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <utility>
+#include <vector>
+
+void printStats(std::ostream& out, const RunStats& stats, StatsFormat format) {
+    if (format == StatsFormat::None) {
+        return;
+    }
+
+    bool compressing = std::string(stats.operation) == "compress";
+    uint64_t rawBytes = compressing ? stats.bytesIn : stats.bytesOut;
+    uint64_t compressedBytes = compressing ? stats.bytesOut : stats.bytesIn;
+    double bitsPerSymbol = rawBytes == 0 ? 0.0 : 8.0 * static_cast<double>(compressedBytes) / static_cast<double>(rawBytes);
+    double busy = stats.encoder.histogram + stats.encoder.checksum + stats.encoder.tree + stats.encoder.header +
+                  stats.encoder.encode + stats.decoder.table + stats.decoder.decode + stats.decoder.checksum;
+    double utilization = stats.wall > 0 && stats.threads > 0 ? busy / (stats.wall * stats.threads) : 0.0;
+
+    // Phases that apply to this operation, in milliseconds
+    std::vector<std::pair<const char*, double>> phases;
+    if (compressing) {
+        phases = {{"histogram", stats.encoder.histogram}, {"checksum", stats.encoder.checksum},
+                  {"tree_build", stats.encoder.tree}, {"header_write", stats.encoder.header},
+                  {"encode", stats.encoder.encode}, {"dedup", stats.dedup}, {"flush", stats.flush}};
+    } else {
+        phases = {{"table_build", stats.decoder.table}, {"decode", stats.decoder.decode},
+                  {"checksum", stats.decoder.checksum}};
+    }
+    phases.push_back({"io_read", stats.read});
+    phases.push_back({"io_write", stats.write});
+    phases.push_back({"worker_wait", stats.wait});
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    if (format == StatsFormat::Json) {
+        out << "{\"operation\": \"" << stats.operation << "\", \"bytes_in\": " << stats.bytesIn
+            << ", \"bytes_out\": " << stats.bytesOut << ", \"blocks\": " << stats.blocks
+            << ", \"dedup_blocks\": " << stats.dedupBlocks << ", \"reused_tables\": " << stats.reusedTables
+            << ", \"tans_blocks\": " << stats.tansBlocks << ", \"threads\": " << stats.threads
+            << ", \"bits_per_symbol\": " << bitsPerSymbol << ", \"thread_utilization\": " << utilization
+            << ", \"wall_ms\": " << stats.wall * 1e3
+            << ", \"phases_ms\": {";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            out << (i > 0 ? ", " : "") << "\"" << phases[i].first << "\": " << phases[i].second * 1e3;
+        }
+        out << "}, \"stalls\": {\"reader\": " << stats.stalls.reader << ", \"coder\": " << stats.stalls.coder
+            << ", \"writer\": " << stats.stalls.writer << "}}\n";
+    } else {
+        out << "Statistics (" << stats.operation << "):\n";
+        out << "  bytes in:           " << stats.bytesIn << "\n";
+        out << "  bytes out:          " << stats.bytesOut << "\n";
+        out << "  blocks:             " << stats.blocks << "\n";
+        out << "  dedup blocks:       " << stats.dedupBlocks << "\n";
+        out << "  reused tables:      " << stats.reusedTables << "\n";
+        out << "  tANS blocks:        " << stats.tansBlocks << "\n";
+        out << "  threads:            " << stats.threads << "\n";
+        out << "  bits per symbol:    " << bitsPerSymbol << "\n";
+        out << "  thread utilization: " << utilization * 100.0 << "%\n";
+        out << "  wall time:          " << stats.wall * 1e3 << " ms\n";
+        for (const auto& [name, seconds] : phases) {
+            std::string label = std::string(name) + ":";
+            std::replace(label.begin(), label.end(), '_', ' ');
+            out << "  " << std::left << std::setw(20) << label << std::right << seconds * 1e3 << " ms\n";
+        }
+        out << "  reader stalls:      " << stats.stalls.reader << "\n";
+        out << "  coder stalls:       " << stats.stalls.coder << "\n";
+        out << "  writer stalls:      " << stats.stalls.writer << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
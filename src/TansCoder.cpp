@@ -0,0 +1,400 @@
+// src/TansCoder.cpp
+#include "TansCoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Index of the highest set bit; value must not be 0
+inline int highBit(uint32_t value) {
+    return 31 - __builtin_clz(value);
+}
+
+// State order of the symbols: each symbol gets as many states as its count,
+// scattered over the table so that its states are spread evenly. The step
+// is odd, so it visits every state of the power-of-two table once.
+void spreadSymbols(const NormalizedCounts& counts, int tableLog, std::vector<ORIGINAL_DATA_TYPE>& spread) {
+    const uint32_t tableSize = 1u << tableLog;
+    const uint32_t mask = tableSize - 1;
+    const uint32_t step = (tableSize >> 1) + (tableSize >> 3) + 3;
+    spread.resize(tableSize);
+    uint32_t position = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        for (uint32_t i = 0; i < counts[ch]; ++i) {
+            spread[position] = static_cast<ORIGINAL_DATA_TYPE>(ch);
+            position = (position + step) & mask;
+        }
+    }
+}
+
+} // namespace
+
+int tansTableLog(size_t size, size_t symbolCount) {
+    // No more states than about twice the symbols to code
+    int tableLog = TANS_MAX_TABLE_LOG;
+    while (tableLog > TANS_MIN_TABLE_LOG && (size_t{1} << (tableLog - 1)) >= size) {
+        tableLog--;
+    }
+    // Every symbol needs a state, with room left to follow the counts
+    int minLog = symbolCount > 1 ? highBit(static_cast<uint32_t>(symbolCount - 1)) + 2 : TANS_MIN_TABLE_LOG;
+    return std::min(TANS_MAX_TABLE_LOG, std::max(tableLog, minLog));
+}
+
+void normalizeCounts(const FrequencyTable& frequencies, size_t size, int tableLog, NormalizedCounts& counts) {
+    const uint32_t tableSize = 1u << tableLog;
+    uint32_t total = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        counts[ch] = 0;
+        if (frequencies[ch] > 0) {
+            uint64_t scaled = static_cast<uint64_t>(frequencies[ch]) * tableSize / size;
+            counts[ch] = static_cast<uint16_t>(scaled > 0 ? scaled : 1);
+            total += counts[ch];
+        }
+    }
+
+    // Rounding leaves the total off by up to one per symbol. A symbol with f
+    // occurrences and count n gains or loses about f / n bits per unit of
+    // count, so units go to where they save most and come from where they
+    // cost least.
+    while (total < tableSize) {
+        int best = -1;
+        double bestGain = 0;
+        for (int ch = 0; ch < 256; ++ch) {
+            if (counts[ch] > 0) {
+                double gain = frequencies[ch] / (counts[ch] + 0.5);
+                if (gain > bestGain) {
+                    best = ch;
+                    bestGain = gain;
+                }
+            }
+        }
+        counts[best]++;
+        total++;
+    }
+    while (total > tableSize) {
+        int best = -1;
+        double bestLoss = 0;
+        for (int ch = 0; ch < 256; ++ch) {
+            if (counts[ch] > 1) {
+                double loss = frequencies[ch] / (counts[ch] - 0.5);
+                if (best < 0 || loss < bestLoss) {
+                    best = ch;
+                    bestLoss = loss;
+                }
+            }
+        }
+        counts[best]--;
+        total--;
+    }
+}
+
+uint64_t tansCodedBits(const FrequencyTable& frequencies, const NormalizedCounts& counts, int tableLog) {
+    double bits = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (frequencies[ch] > 0) {
+            bits += frequencies[ch] * (tableLog - std::log2(static_cast<double>(counts[ch])));
+        }
+    }
+    // The final states and the end marker
+    return static_cast<uint64_t>(std::ceil(bits)) + TANS_STATE_COUNT * tableLog + 1;
+}
+
+void writeNormalizedCounts(std::vector<uint8_t>& out, const NormalizedCounts& counts, int tableLog) {
+    size_t symbolCount = 0;
+    for (uint16_t count : counts) {
+        symbolCount += count > 0;
+    }
+    out.push_back(static_cast<uint8_t>(tableLog));
+    out.push_back(static_cast<uint8_t>(symbolCount - 1));
+    if (symbolCount < SYMBOL_BITMAP_SIZE) {
+        for (int ch = 0; ch < 256; ++ch) {
+            if (counts[ch] > 0) {
+                out.push_back(static_cast<uint8_t>(ch));
+            }
+        }
+    } else {
+        size_t bitmap = out.size();
+        out.resize(bitmap + SYMBOL_BITMAP_SIZE, 0);
+        for (int ch = 0; ch < 256; ++ch) {
+            if (counts[ch] > 0) {
+                out[bitmap + ch / 8] |= static_cast<uint8_t>(0x80 >> (ch % 8));
+            }
+        }
+    }
+    for (uint16_t count : counts) {
+        if (count > 0) {
+            appendVarint(out, count - 1u);
+        }
+    }
+}
+
+size_t normalizedCountsSize(const NormalizedCounts& counts) {
+    size_t symbolCount = 0;
+    size_t countBytes = 0;
+    for (uint16_t count : counts) {
+        if (count > 0) {
+            symbolCount++;
+            countBytes += varintSize(count - 1u);
+        }
+    }
+    return 2 + std::min(symbolCount, SYMBOL_BITMAP_SIZE) + countBytes;
+}
+
+NormalizedCounts readNormalizedCounts(const uint8_t*& cur, const uint8_t* end, int& tableLog) {
+    if (end - cur < 2) {
+        throw std::runtime_error("Unable to read tANS counts");
+    }
+    tableLog = *cur++;
+    if (tableLog < TANS_MIN_TABLE_LOG || tableLog > TANS_MAX_TABLE_LOG) {
+        throw std::runtime_error("Corrupt block: invalid tANS table size");
+    }
+    size_t symbolCount = static_cast<size_t>(*cur++) + 1;
+
+    // The symbols: a plain list for short alphabets, a presence bitmap otherwise
+    std::vector<uint8_t> symbols;
+    if (symbolCount < SYMBOL_BITMAP_SIZE) {
+        if (static_cast<size_t>(end - cur) < symbolCount) {
+            throw std::runtime_error("Unable to read symbol list");
+        }
+        symbols.assign(cur, cur + symbolCount);
+        cur += symbolCount;
+    } else {
+        if (static_cast<size_t>(end - cur) < SYMBOL_BITMAP_SIZE) {
+            throw std::runtime_error("Unable to read symbol bitmap");
+        }
+        for (int ch = 0; ch < 256; ++ch) {
+            if (cur[ch / 8] & (0x80 >> (ch % 8))) {
+                symbols.push_back(static_cast<uint8_t>(ch));
+            }
+        }
+        cur += SYMBOL_BITMAP_SIZE;
+        if (symbols.size() != symbolCount) {
+            throw std::runtime_error("Symbol bitmap does not match symbol count");
+        }
+    }
+
+    // The counts must fill the table exactly
+    const uint64_t tableSize = 1u << tableLog;
+    NormalizedCounts counts{};
+    uint64_t total = 0;
+    for (uint8_t symbol : symbols) {
+        uint64_t count = readVarint(cur, end) + 1;
+        if (count > tableSize || counts[symbol] != 0) {
+            throw std::runtime_error("Corrupt block: invalid tANS counts");
+        }
+        counts[symbol] = static_cast<uint16_t>(count);
+        total += count;
+    }
+    if (total != tableSize) {
+        throw std::runtime_error("Corrupt block: invalid tANS counts");
+    }
+    return counts;
+}
+
+void TansEncodeTable::build(const NormalizedCounts& counts, int log) {
+    tableLog = log;
+    const uint32_t tableSize = 1u << tableLog;
+    std::vector<ORIGINAL_DATA_TYPE> spread;
+    spreadSymbols(counts, tableLog, spread);
+
+    // The states of each symbol are consecutive in nextStates, in state order
+    std::array<uint32_t, 256> next;
+    uint32_t cumulative = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        next[ch] = cumulative;
+        cumulative += counts[ch];
+    }
+    nextStates.resize(tableSize);
+    for (uint32_t state = 0; state < tableSize; ++state) {
+        nextStates[next[spread[state]]++] = static_cast<uint16_t>(tableSize + state);
+    }
+
+    // A symbol with count n takes states from [tableSize, 2 * tableSize) down
+    // to [n, 2n) by dropping maxBitsOut bits, or one fewer below n << maxBitsOut
+    cumulative = 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        uint32_t count = counts[ch];
+        if (count == 1) {
+            transforms[ch].deltaNbBits = (static_cast<uint32_t>(tableLog) << 16) - tableSize;
+            transforms[ch].deltaFindState = static_cast<int32_t>(cumulative) - 1;
+        } else if (count > 1) {
+            uint32_t maxBitsOut = static_cast<uint32_t>(tableLog - highBit(count - 1));
+            transforms[ch].deltaNbBits = (maxBitsOut << 16) - (count << maxBitsOut);
+            transforms[ch].deltaFindState = static_cast<int32_t>(cumulative) - static_cast<int32_t>(count);
+        }
+        cumulative += count;
+    }
+}
+
+void TansEncodeTable::encode(std::vector<uint8_t>& out, const ORIGINAL_DATA_TYPE* data, size_t size) const {
+    const uint32_t tableSize = 1u << tableLog;
+    size_t start = out.size();
+    // At most tableLog bits per symbol, then the states and the end marker,
+    // plus room for the last 8-byte store
+    out.resize(start + (size * tableLog + TANS_STATE_COUNT * tableLog + 1 + 7) / 8 + 8);
+    uint8_t* dst = out.data() + start;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+    auto putBits = [&](uint32_t value, int count) {
+        bitBuffer |= static_cast<uint64_t>(value) << bitCount;
+        bitCount += count;
+    };
+    // Store the whole bytes, leaving fewer than 8 bits pending
+    auto flush = [&]() {
+        int bytes = bitCount >> 3;
+        storeUint32(dst, static_cast<uint32_t>(bitBuffer));
+        storeUint32(dst + 4, static_cast<uint32_t>(bitBuffer >> 32));
+        dst += bytes;
+        bitBuffer = bytes > 0 ? bitBuffer >> (bytes * 8) : bitBuffer;
+        bitCount &= 7;
+    };
+    auto encodeSymbol = [&](uint32_t& state, ORIGINAL_DATA_TYPE symbol) {
+        const SymbolTransform& transform = transforms[symbol];
+        uint32_t nbBits = (state + transform.deltaNbBits) >> 16;
+        putBits(state & ((1u << nbBits) - 1), static_cast<int>(nbBits));
+        state = nextStates[static_cast<int32_t>(state >> nbBits) + transform.deltaFindState];
+    };
+
+    // Last symbol first, symbol i through state i % TANS_STATE_COUNT; a
+    // round adds at most TANS_STATE_COUNT * TANS_MAX_TABLE_LOG bits
+    uint32_t states[TANS_STATE_COUNT];
+    for (uint32_t& state : states) {
+        state = tableSize;
+    }
+    size_t i = size;
+    while (i % TANS_STATE_COUNT != 0) {
+        --i;
+        encodeSymbol(states[i % TANS_STATE_COUNT], data[i]);
+    }
+    flush();
+    while (i > 0) {
+        i -= TANS_STATE_COUNT;
+        for (int k = TANS_STATE_COUNT - 1; k >= 0; --k) {
+            encodeSymbol(states[k], data[i + k]);
+        }
+        flush();
+    }
+
+    // The decoder starts from the end: marker bit, then the states in order
+    for (int k = TANS_STATE_COUNT - 1; k >= 0; --k) {
+        putBits(states[k] - tableSize, tableLog);
+    }
+    putBits(1, 1);
+    flush();
+    if (bitCount > 0) {
+        *dst++ = static_cast<uint8_t>(bitBuffer);
+    }
+    out.resize(static_cast<size_t>(dst - out.data()));
+}
+
+void TansDecodeTable::build(const NormalizedCounts& counts, int log) {
+    tableLog = log;
+    const uint32_t tableSize = 1u << tableLog;
+    std::vector<ORIGINAL_DATA_TYPE> spread;
+    spreadSymbols(counts, tableLog, spread);
+
+    // The k-th state of a symbol with count n leads back to n + k, scaled up
+    // into the table by the bits the encoder dropped
+    std::array<uint32_t, 256> next;
+    for (int ch = 0; ch < 256; ++ch) {
+        next[ch] = counts[ch];
+    }
+    entries.resize(tableSize);
+    for (uint32_t state = 0; state < tableSize; ++state) {
+        ORIGINAL_DATA_TYPE symbol = spread[state];
+        uint32_t value = next[symbol]++;
+        int nbBits = tableLog - highBit(value);
+        entries[state].newState = static_cast<uint16_t>((value << nbBits) - tableSize);
+        entries[state].symbol = symbol;
+        entries[state].nbBits = static_cast<uint8_t>(nbBits);
+    }
+}
+
+void TansDecodeTable::decode(const uint8_t* data, size_t dataSize, uint32_t rawSize,
+                             ORIGINAL_DATA_TYPE* output) const {
+    if (dataSize == 0 || data[dataSize - 1] == 0) {
+        throw std::runtime_error("Corrupt block: tANS stream has no end marker");
+    }
+    // The stream is read through an 8-byte window moving from its end to
+    // its start; shorter streams are placed at the end of a zeroed window
+    uint8_t shortStream[8] = {};
+    const uint8_t* start = data;
+    size_t paddingBits = 0;
+    if (dataSize < sizeof(shortStream)) {
+        std::memcpy(shortStream + sizeof(shortStream) - dataSize, data, dataSize);
+        paddingBits = (sizeof(shortStream) - dataSize) * 8;
+        start = shortStream;
+        dataSize = sizeof(shortStream);
+    }
+    const uint8_t* window = start + dataSize - 8;
+    uint64_t bitBuffer = loadUint64(window);
+    // Bits already read, counted from the top of the window
+    int bitsConsumed = __builtin_clzll(bitBuffer) + 1;
+
+    // Up to 32 bits; bitsConsumed must stay below 64 before the read
+    auto readBits = [&](int count) {
+        uint32_t value = static_cast<uint32_t>(((bitBuffer << bitsConsumed) >> 1) >> (63 - count));
+        bitsConsumed += count;
+        return value;
+    };
+    // Move the window back over the whole bytes read, but not past the
+    // start of the stream
+    auto reload = [&]() {
+        size_t back = std::min(static_cast<size_t>(bitsConsumed >> 3), static_cast<size_t>(window - start));
+        window -= back;
+        bitsConsumed -= static_cast<int>(back * 8);
+        bitBuffer = loadUint64(window);
+    };
+
+    uint32_t states[TANS_STATE_COUNT];
+    for (uint32_t& state : states) {
+        state = readBits(tableLog);
+        reload();
+    }
+    const Entry* table = entries.data();
+
+    // One symbol per state between reloads, at most TANS_STATE_COUNT *
+    // TANS_MAX_TABLE_LOG bits after at most 7 left over, for as long as the
+    // window can move back by whole bytes without checks
+    static_assert(TANS_STATE_COUNT * TANS_MAX_TABLE_LOG + 7 < 64, "a round of symbols must fit the window");
+    uint32_t i = 0;
+    while (window - start >= 8 && rawSize - i >= TANS_STATE_COUNT) {
+        for (int k = 0; k < TANS_STATE_COUNT; ++k) {
+            const Entry& entry = table[states[k]];
+            output[i + k] = entry.symbol;
+            states[k] = entry.newState + readBits(entry.nbBits);
+        }
+        i += TANS_STATE_COUNT;
+        window -= bitsConsumed >> 3;
+        bitsConsumed &= 7;
+        bitBuffer = loadUint64(window);
+    }
+
+    // The last symbols, near the start of the stream, one at a time
+    for (; i < rawSize; ++i) {
+        uint32_t& state = states[i % TANS_STATE_COUNT];
+        const Entry& entry = table[state];
+        output[i] = entry.symbol;
+        if (bitsConsumed + entry.nbBits > 64) {
+            reload();
+            if (bitsConsumed + entry.nbBits > 64) {
+                throw std::runtime_error("Corrupt block: tANS stream too short");
+            }
+        }
+        state = entry.newState + (entry.nbBits > 0 ? readBits(entry.nbBits) : 0);
+    }
+
+    // Every state ends where the encoder started, with every bit read
+    reload();
+    size_t unread = static_cast<size_t>(window - start) * 8 + static_cast<size_t>(64 - bitsConsumed);
+    for (uint32_t state : states) {
+        if (state != 0) {
+            throw std::runtime_error("Corrupt block: tANS stream does not end cleanly");
+        }
+    }
+    if (unread != paddingBits) {
+        throw std::runtime_error("Corrupt block: tANS stream does not end cleanly");
+    }
+}
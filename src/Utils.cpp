@@ -1,23 +1,142 @@
-// src/Utils.cpp
-#include "Utils.h"
-#include <filesystem>
-
-namespace fs = std::filesystem;
-
-std::string getAbsolutePath(const std::string& filename) {
-    fs::path p = fs::absolute(filename);
-    return p.string();
-}
-
-void printHelp(std::ostream& out) {
-    out << "Usage: huff -[c|d] <infile> <outfile>\n";
-    out << "Compress or decompress file using Huffman coding.\n";
-    out << "<infile>  Input file, it's required to be in the same directory as the executable file.\n";
-    out << "<outfile> Output file, it's required to be in the same directory as the executable file.\n";
-    out << "Example: huff -c input.txt output.huff\n";
-    out << "         huff -d output.huff recovered.txt\n";
-    out << "Options:\n";
-    out << "  -c  Compress infile to outfile\n";
-    out << "  -d  Decompress infile to outfile\n";
-    out << "  -h, --help  Show this help message\n";
-}
+// src/Utils.cpp
+#include "Utils.h"
+#include <filesystem>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+std::string getAbsolutePath(const std::string& filename) {
+    fs::path p = fs::absolute(filename);
+    return p.string();
+}
+
+bool isStandardStream(const std::string& path) {
+    return path == "-";
+}
+
+void printHelp(std::ostream& out) {
+    out << "Usage: huff [options] -[c|d] <infile> <outfile>\n";
+    out << "       huff [options] -x <offset>:<length> <infile> <outfile>\n";
+    out << "       huff [options] -t <infile>\n";
+    out << "       huff [options] -c -r <dir> <archive>\n";
+    out << "       huff [options] -d -r <archive> <dir> [<file>...]\n";
+    out << "       huff [options] --train <table> <sample>...\n";
+    out << "Compress or decompress file using Huffman coding.\n";
+    out << "<infile>  Input file, it's required to be in the same directory as the executable file.\n";
+    out << "<outfile> Output file, it's required to be in the same directory as the executable file.\n";
+    out << "Use - as <infile> or <outfile> to read from standard input or write to standard output.\n";
+    out << "Example: huff -c input.txt output.huff\n";
+    out << "         huff -d output.huff recovered.txt\n";
+    out << "         tar cf - dir | huff -c - - | ssh host 'huff -d - - | tar xf -'\n";
+    out << "         huff --train records.hzt samples/ && huff -D records.hzt -c record.json record.huff\n";
+    out << "Options:\n";
+    out << "  -c  Compress infile to outfile\n";
+    out << "  -d  Decompress infile to outfile\n";
+    out << "  -r  Archive mode: compress all files under a directory into one archive, or extract an\n";
+    out << "      archive into a directory (only the named files, if any are given); empty\n";
+    out << "      directories are skipped\n";
+    out << "  -t  Test infile or archive: decode it and check every checksum without writing output\n";
+    out << "  -x <offset>:<length>  Extract a byte range of the original data without decompressing the rest\n";
+    out << "  --train <table>  Build a shared code table from sample files or directories and save it to <table>\n";
+    out << "  -D <table>  Compress with a shared table, or decompress data compressed with it\n";
+    out << "  -l <bits>  Maximum code length when compressing (8-15, default 15)\n";
+    out << "  -s <streams>  Bit streams per block when compressing: 4 (default, faster decoding) or 1\n";
+    out << "  --coder <coder>  Entropy coder when compressing: auto (default, tANS for blocks it codes\n";
+    out << "      clearly smaller), huffman or tans\n";
+    out << "  -T <threads>  Number of worker threads (default: one per core)\n";
+    out << "  --dedup  Store blocks that repeat one of the blocks in the last 128 MiB as references to it\n";
+    out << "  -v, --verbose  Print symbol frequencies and sizes after compressing\n";
+    out << "  --stats[=json]  Print per-phase timings and sizes to standard error, as text or JSON\n";
+    out << "  -h, --help  Show this help message\n";
+}
+
+FileDescriptor::FileDescriptor(const std::string& path, int flags, int mode)
+    : fd(::open(path.c_str(), flags, mode)) {
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + path + " (" + std::strerror(errno) + ")");
+    }
+}
+
+FileDescriptor::~FileDescriptor() {
+    ::close(fd);
+}
+
+uint64_t FileDescriptor::size() const {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error(std::string("Unable to get file size: ") + std::strerror(errno));
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+bool FileDescriptor::isRegular() const {
+    return isRegularFile(fd);
+}
+
+bool isRegularFile(int fd) {
+    struct stat st;
+    return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void readAt(int fd, void* buffer, size_t size, uint64_t offset) {
+    char* cur = static_cast<char*>(buffer);
+    while (size > 0) {
+        ssize_t got = ::pread(fd, cur, size, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            throw std::runtime_error(got == 0 ? "Unexpected end of file" : std::string("Read error: ") + std::strerror(errno));
+        }
+        cur += got;
+        size -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+}
+
+size_t readSome(int fd, void* buffer, size_t size) {
+    char* cur = static_cast<char*>(buffer);
+    size_t total = 0;
+    while (total < size) {
+        ssize_t got = ::read(fd, cur + total, size - total);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            throw std::runtime_error(std::string("Read error: ") + std::strerror(errno));
+        }
+        if (got == 0) {
+            break;
+        }
+        total += static_cast<size_t>(got);
+    }
+    return total;
+}
+
+void writeAt(int fd, const void* buffer, size_t size, uint64_t offset) {
+    const char* cur = static_cast<const char*>(buffer);
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, cur, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            throw std::runtime_error(std::string("Write error: ") + std::strerror(errno));
+        }
+        cur += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+void writeAll(int fd, const void* buffer, size_t size) {
+    const char* cur = static_cast<const char*>(buffer);
+    while (size > 0) {
+        ssize_t written = ::write(fd, cur, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            throw std::runtime_error(std::string("Write error: ") + std::strerror(errno));
+        }
+        cur += written;
+        size -= static_cast<size_t>(written);
+    }
+}
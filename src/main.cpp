@@ -1,46 +1,164 @@
-// src/main.cpp
-#include "HuffmanEncoder.h"
-#include "HuffmanDecoder.h"
-#include "Utils.h"
-#include <iostream>
-#include <cstring>
-#include <cstdlib>
-
-int main(int argc, char* argv[]) {
-    try {
-        if (argc != 4) {
-            if (argc == 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
-                printHelp(std::cout);
-                return EXIT_SUCCESS;
-            }
-            if (argc > 4)
-                std::cerr << "Too many arguments\n\n";
-            else
-                std::cerr << "Too few arguments\n\n";
-            printHelp(std::cout);
-            return EXIT_FAILURE;
-        }
-
-        std::string option = argv[1];
-        std::string inputPath = getAbsolutePath(argv[2]);
-        std::string outputPath = getAbsolutePath(argv[3]);
-
-        if (option == "-c") {
-            HuffmanEncoder encoder;
-            encoder.compress(inputPath, outputPath);
-        } else if (option == "-d") {
-            HuffmanDecoder decoder;
-            decoder.decompress(inputPath, outputPath);
-        } else {
-            std::cerr << "Unknown command\n\n";
-            printHelp(std::cout);
-            return EXIT_FAILURE;
-        }
-
-    } catch (const std::exception& ex) {
-        std::cerr << "Error: " << ex.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-
-    return EXIT_SUCCESS;
-}
+#include "HuffmanEncoder.h"
+#include "HuffmanDecoder.h"
+#include "SharedTable.h"
+#include "Utils.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc == 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+            printHelp(std::cout);
+            return EXIT_SUCCESS;
+        }
+
+        // Split the command line into the command, options and positional arguments
+        std::string command;
+        std::string range;
+        std::string tablePath;
+        bool archive = false;
+        EncoderOptions encoderOptions;
+        DecoderOptions decoderOptions;
+        std::vector<std::string> positional;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-c" || arg == "-d" || arg == "-t") {
+                command = arg;
+            } else if (arg == "-x" || arg == "--train" || arg == "-D" || arg == "-l" || arg == "-s" || arg == "-T" ||
+                       arg == "--coder") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Option " << arg << " requires a value\n\n";
+                    printHelp(std::cout);
+                    return EXIT_FAILURE;
+                }
+                std::string value = argv[++i];
+                if (arg == "-x") {
+                    command = arg;
+                    range = value;
+                } else if (arg == "--train") {
+                    command = arg;
+                    tablePath = value;
+                } else if (arg == "-D") {
+                    tablePath = value;
+                } else if (arg == "-l") {
+                    encoderOptions.maxCodeLength = std::stoi(value);
+                } else if (arg == "-s") {
+                    encoderOptions.streams = std::stoi(value);
+                } else if (arg == "--coder") {
+                    if (value == "auto") {
+                        encoderOptions.coder = EntropyCoder::Auto;
+                    } else if (value == "huffman") {
+                        encoderOptions.coder = EntropyCoder::Huffman;
+                    } else if (value == "tans") {
+                        encoderOptions.coder = EntropyCoder::Tans;
+                    } else {
+                        throw std::invalid_argument("Unknown coder: " + value + " (auto, huffman or tans)");
+                    }
+                } else {
+                    int threads = std::stoi(value);
+                    if (threads < 0) {
+                        throw std::invalid_argument("Thread count must not be negative");
+                    }
+                    encoderOptions.threads = static_cast<unsigned>(threads);
+                    decoderOptions.threads = static_cast<unsigned>(threads);
+                }
+            } else if (arg == "-r") {
+                archive = true;
+            } else if (arg == "--dedup") {
+                encoderOptions.dedup = true;
+            } else if (arg == "-v" || arg == "--verbose") {
+                encoderOptions.verbose = true;
+            } else if (arg == "--stats" || arg == "--stats=text" || arg == "--stats=json") {
+                StatsFormat format = arg == "--stats=json" ? StatsFormat::Json : StatsFormat::Text;
+                encoderOptions.stats = format;
+                decoderOptions.stats = format;
+            } else if (arg.size() > 1 && arg[0] == '-') { // A lone "-" is a path
+                std::cerr << "Unknown command\n\n";
+                printHelp(std::cout);
+                return EXIT_FAILURE;
+            } else {
+                positional.push_back(arg);
+            }
+        }
+
+        if (command.empty()) {
+            std::cerr << "Unknown command\n\n";
+            printHelp(std::cout);
+            return EXIT_FAILURE;
+        }
+        if (command == "--train") {
+            // Every positional argument is a sample file or directory
+            if (positional.empty()) {
+                std::cerr << "Too few arguments\n\n";
+                printHelp(std::cout);
+                return EXIT_FAILURE;
+            }
+            SharedTable table = SharedTable::train(positional, encoderOptions.maxCodeLength);
+            table.save(tablePath);
+            std::cout << "Table " << table.id() << " written to " << tablePath << std::endl;
+            return EXIT_SUCCESS;
+        }
+        if (!tablePath.empty()) {
+            auto table = std::make_shared<const SharedTable>(SharedTable::load(tablePath));
+            encoderOptions.table = table;
+            decoderOptions.table = table;
+        }
+        // -t takes only the compressed file; archive extraction may name
+        // the files to extract after the output directory
+        size_t pathCount = command == "-t" ? 1 : 2;
+        bool extraNames = archive && command == "-d";
+        if (positional.size() < pathCount || (positional.size() > pathCount && !extraNames)) {
+            if (positional.size() > pathCount)
+                std::cerr << "Too many arguments\n\n";
+            else
+                std::cerr << "Too few arguments\n\n";
+            printHelp(std::cout);
+            return EXIT_FAILURE;
+        }
+
+        std::string inputPath = isStandardStream(positional[0]) ? positional[0] : getAbsolutePath(positional[0]);
+        if (command == "-t") {
+            HuffmanDecoder decoder(decoderOptions);
+            decoder.test(inputPath);
+            return EXIT_SUCCESS;
+        }
+        std::string outputPath = isStandardStream(positional[1]) ? positional[1] : getAbsolutePath(positional[1]);
+
+        if (archive) {
+            if (command == "-c") {
+                HuffmanEncoder encoder(encoderOptions);
+                encoder.compressArchive(inputPath, outputPath);
+            } else if (command == "-d") {
+                HuffmanDecoder decoder(decoderOptions);
+                decoder.extractArchive(inputPath, outputPath,
+                                       std::vector<std::string>(positional.begin() + 2, positional.end()));
+            } else {
+                throw std::invalid_argument("-r works with -c and -d only");
+            }
+        } else if (command == "-c") {
+            HuffmanEncoder encoder(encoderOptions);
+            encoder.compress(inputPath, outputPath);
+        } else if (command == "-d") {
+            HuffmanDecoder decoder(decoderOptions);
+            decoder.decompress(inputPath, outputPath);
+        } else {
+            // Byte range given as <offset>:<length>
+            size_t colon = range.find(':');
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("Range must be given as <offset>:<length>");
+            }
+            uint64_t offset = std::stoull(range.substr(0, colon));
+            uint64_t length = std::stoull(range.substr(colon + 1));
+            HuffmanDecoder decoder(decoderOptions);
+            decoder.extract(inputPath, outputPath, offset, length);
+        }
+
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}